@@ -0,0 +1,243 @@
+// shared by every boids compute kernel (include after #version)
+
+layout (binding = 0) uniform UniformBufferObject
+{
+    float MAX_SPEED;
+    float ATTRACTION;
+    float WALL_AVOIDANCE;
+    float ATTRACTION_DISTANCE;
+    float ALIGNMENT_DISTANCE;
+    float ALIGNMENT;
+    float AVOIDANCE_DISTANCE;
+    float AVOIDANCE;
+    float VORTEX_FORCE;
+    // temporal level of detail, see lod_common.glsl
+    vec4 LOD_CAMERA;
+    float LOD_NEAR_DISTANCE;
+    float LOD_DISTANCE_STEP;
+    uint LOD_MAX_INTERVAL;
+    uint LOD_MODE;
+} ubo;
+
+// particle state as packed streams (see ParticleLayout.hpp), color lives in its own buffer
+// and is never touched by the simulation
+layout(std430, binding = 1) readonly buffer PositionRead
+{
+   vec4 positionsRead[];
+};
+
+layout(std430, binding = 2) readonly buffer VelocityRead
+{
+   vec4 velocitiesRead[];
+};
+
+layout(std430, binding = 3) writeonly buffer PositionWrite
+{
+   vec4 positionsWrite[];
+};
+
+layout(std430, binding = 4) writeonly buffer VelocityWrite
+{
+   vec4 velocitiesWrite[];
+};
+
+// heading of the new state for the renderer, only ever derived from the velocity
+layout(std430, binding = 23) writeonly buffer OrientationWrite
+{
+   vec4 orientationsWrite[];
+};
+
+// live particle count N, written by the host or by any pass that spawns or removes particles,
+// followed by the indirect arguments particle_count.glsl derives from it (ParticleLayout::ParticleCount)
+layout(std430, binding = 22) buffer ParticleCount
+{
+    uint N;
+    uint particleDispatch[3];
+    uint sortDispatch[3];
+};
+
+
+// specialization constants, see ShaderConstants.hpp
+layout(constant_id = 0) const uint CAPACITY = 30000;
+layout(constant_id = 1) const uint WORKGROUP_SIZE = 256;
+layout(constant_id = 2) const float FIELD_SCALE = 1.0;
+layout(constant_id = 3) const bool ENABLE_WALL_AVOIDANCE = true;
+layout(constant_id = 4) const bool ENABLE_ATTRACTION = true;
+layout(constant_id = 5) const bool ENABLE_ALIGNMENT = true;
+layout(constant_id = 6) const bool ENABLE_AVOIDANCE = true;
+layout(constant_id = 7) const bool ENABLE_VORTEX = true;
+layout(constant_id = 9) const bool DETERMINISTIC = false;
+
+
+// deterministic mode sums each rule in 32 bit fixed point relative to the particle, integer adds give the same result
+// in any neighbor order, one rule distance (or MAX_SPEED) is fixedLimit() units so CAPACITY neighbors never overflow
+// (a function, specialization constants cannot be converted to float in a constant expression)
+float fixedLimit()
+{
+    return float(0x7fffffffu / CAPACITY);
+}
+
+ivec3 toFixed(vec3 v, float range)
+{
+    float limit = fixedLimit();
+    return ivec3(clamp(v * (limit / range), -limit, limit));
+}
+
+vec3 fromFixed(ivec3 v, float range)
+{
+    return vec3(v) / (fixedLimit() / range);
+}
+
+
+struct Neighborhood
+{
+    vec3 attractionPosSum;
+    int attractionNearCnt;
+    vec3 alignmentVelSum;
+    int alignmentNearCnt;
+    vec3 avoidanceSum;
+    int avoidanceNearCnt;
+    // deterministic mode, sum of p - pos, v and pos - p in place of the three sums above
+    ivec3 attractionFixed;
+    ivec3 alignmentFixed;
+    ivec3 avoidanceFixed;
+};
+
+Neighborhood emptyNeighborhood()
+{
+    Neighborhood n;
+    n.attractionPosSum = vec3(0,0,0);
+    n.attractionNearCnt = 0;
+    n.alignmentVelSum = vec3(0,0,0);
+    n.alignmentNearCnt = 0;
+    n.avoidanceSum = vec3(0,0,0);
+    n.avoidanceNearCnt = 0;
+    n.attractionFixed = ivec3(0);
+    n.alignmentFixed = ivec3(0);
+    n.avoidanceFixed = ivec3(0);
+    return n;
+}
+
+void addNeighbor(inout Neighborhood n, vec3 pos, vec3 p, vec3 v)
+{
+    float dist = length(p - pos);
+    
+    if(ENABLE_ATTRACTION && dist < ubo.ATTRACTION_DISTANCE)
+    {
+        if(DETERMINISTIC) n.attractionFixed += toFixed(p - pos, ubo.ATTRACTION_DISTANCE);
+        else n.attractionPosSum += p;
+        n.attractionNearCnt++;
+    }
+    
+    if(ENABLE_ALIGNMENT && dist < ubo.ALIGNMENT_DISTANCE)
+    {
+        if(DETERMINISTIC) n.alignmentFixed += toFixed(v, ubo.MAX_SPEED);
+        else n.alignmentVelSum += v;
+        n.alignmentNearCnt++;
+    }
+    
+    if(ENABLE_AVOIDANCE && dist < ubo.AVOIDANCE_DISTANCE)
+    {
+        if(DETERMINISTIC) n.avoidanceFixed += toFixed(pos - p, ubo.AVOIDANCE_DISTANCE);
+        else n.avoidanceSum += pos - p;
+        n.avoidanceNearCnt++;
+    }
+}
+
+// same as addNeighbor for particle i, the velocity is only fetched when the particle is close enough to align with
+void addNeighborAt(inout Neighborhood n, vec3 pos, uint i)
+{
+    vec3 p = positionsRead[i].xyz;
+    float dist = length(p - pos);
+    
+    if(ENABLE_ATTRACTION && dist < ubo.ATTRACTION_DISTANCE)
+    {
+        if(DETERMINISTIC) n.attractionFixed += toFixed(p - pos, ubo.ATTRACTION_DISTANCE);
+        else n.attractionPosSum += p;
+        n.attractionNearCnt++;
+    }
+    
+    if(ENABLE_ALIGNMENT && dist < ubo.ALIGNMENT_DISTANCE)
+    {
+        if(DETERMINISTIC) n.alignmentFixed += toFixed(velocitiesRead[i].xyz, ubo.MAX_SPEED);
+        else n.alignmentVelSum += velocitiesRead[i].xyz;
+        n.alignmentNearCnt++;
+    }
+    
+    if(ENABLE_AVOIDANCE && dist < ubo.AVOIDANCE_DISTANCE)
+    {
+        if(DETERMINISTIC) n.avoidanceFixed += toFixed(pos - p, ubo.AVOIDANCE_DISTANCE);
+        else n.avoidanceSum += pos - p;
+        n.avoidanceNearCnt++;
+    }
+}
+
+// the fish model faces +y, rotation from +y to the heading as a quaternion (xyz vector part, w scalar part),
+// see ParticleLayout::Orientation
+vec4 orientationOf(vec3 vel)
+{
+    vec3 dir = normalize(vel);
+    float w = 1.0 + dir.y;
+    // heading straight down, half a turn around x
+    if(w < 1e-6) return vec4(1.0, 0.0, 0.0, 0.0);
+    return normalize(vec4(cross(vec3(0.0, 1.0, 0.0), dir), w));
+}
+
+// keeps the velocity of particle id, for steps that skip the rules
+void drift(uint id, vec3 pos, vec3 vel)
+{
+    positionsWrite[id] = vec4(pos + vel, 1.0);
+    velocitiesWrite[id] = vec4(vel, 0.0);
+    orientationsWrite[id] = orientationOf(vel);
+}
+
+// applies wall, flocking and vortex rules then writes the new state of particle id
+void integrate(uint id, vec3 pos, vec3 vel, Neighborhood n)
+{
+    vec3 acc = vec3(0.0);
+    
+    if(ENABLE_WALL_AVOIDANCE)
+    {
+        if(pos.x > FIELD_SCALE) acc.x += -ubo.WALL_AVOIDANCE;
+        if(pos.x < 0.0) acc.x += ubo.WALL_AVOIDANCE;
+        if(pos.y > FIELD_SCALE) acc.y += -ubo.WALL_AVOIDANCE;
+        if(pos.y < 0.0) acc.y += ubo.WALL_AVOIDANCE;
+        if(pos.z > FIELD_SCALE) acc.z += -ubo.WALL_AVOIDANCE;
+        if(pos.z < 0.0) acc.z += ubo.WALL_AVOIDANCE;
+    }
+    
+    if(n.attractionNearCnt > 0)
+    {
+        vec3 meanPos = DETERMINISTIC ? pos + fromFixed(n.attractionFixed, ubo.ATTRACTION_DISTANCE) / n.attractionNearCnt
+                                     : n.attractionPosSum / n.attractionNearCnt;
+        vec3 attractionForce = (meanPos - pos) * ubo.ATTRACTION;
+        acc += attractionForce;
+    }
+    if(n.alignmentNearCnt > 0)
+    {
+        vec3 velSum = DETERMINISTIC ? fromFixed(n.alignmentFixed, ubo.MAX_SPEED) : n.alignmentVelSum;
+        vec3 meanVel = velSum / n.alignmentNearCnt;
+        vec3 alignmentForce = meanVel * ubo.ALIGNMENT;
+        acc += alignmentForce;
+    }
+    if(n.avoidanceNearCnt > 0)
+    {
+        vec3 avoidanceSum = DETERMINISTIC ? fromFixed(n.avoidanceFixed, ubo.AVOIDANCE_DISTANCE) : n.avoidanceSum;
+        acc += avoidanceSum * ubo.AVOIDANCE;
+    }
+    
+    if(ENABLE_VORTEX)
+    {
+        vec3 vortexForce = cross(pos - vec3(0.5, 0.5, 0.5), vec3(1.0, 0.0, 0.0));
+        acc += vortexForce * ubo.VORTEX_FORCE;
+    }
+    
+    
+    vel += acc;
+    if(length(vel) > ubo.MAX_SPEED) vel = normalize(vel) *  ubo.MAX_SPEED;
+    
+    
+    positionsWrite[id] = vec4(pos + vel, 1.0);
+    velocitiesWrite[id] = vec4(vel, 0.0);
+    orientationsWrite[id] = orientationOf(vel);
+}
@@ -0,0 +1,71 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "grid_common.glsl"
+#include "lod_common.glsl"
+
+layout (local_size_x_id = 1, local_size_y = 1, local_size_z = 1) in;
+
+// one tile per workgroup
+shared vec3 tilePos[WORKGROUP_SIZE];
+shared vec3 tileVel[WORKGROUP_SIZE];
+shared uint groupDue;
+
+
+// brute force with shared memory tiling: the workgroup loads WORKGROUP_SIZE particles at once
+// and every invocation tests them from shared memory, so each particle is read
+// from global memory once per workgroup instead of once per invocation
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    uint lid = gl_LocalInvocationID.x;
+    
+    // invocations past N still help loading tiles, they must reach every barrier
+    bool active = id < N;
+    vec3 pos = active ? positionsRead[id].xyz : vec3(0.0);
+    vec3 vel = active ? velocitiesRead[id].xyz : vec3(0.0);
+    
+    // the whole workgroup skips the tiles when none of its particles is due
+    bool due = active && lodDue(id, pos);
+    if(lid == 0) groupDue = 0;
+    barrier();
+    if(due) atomicOr(groupDue, 1);
+    barrier();
+    
+    if(groupDue == 0)
+    {
+        if(active) drift(id, pos, vel);
+        return;
+    }
+    
+    Neighborhood n = emptyNeighborhood();
+    
+    for(uint tile = 0; tile < N; tile += WORKGROUP_SIZE)
+    {
+        uint i = tile + lid;
+        if(i < N)
+        {
+            tilePos[lid] = positionsRead[i].xyz;
+            if(ENABLE_ALIGNMENT) tileVel[lid] = velocitiesRead[i].xyz;
+        }
+        barrier();
+        
+        uint tileCount = min(WORKGROUP_SIZE, N - tile);
+        for(uint j = 0; j < tileCount; j++)
+        {
+            addNeighbor(n, pos, tilePos[j], tileVel[j]);
+        }
+        barrier();
+    }
+    
+    if(due)
+    {
+        lodRecord(id, n);
+        integrate(id, pos, vel, n);
+    }
+    else if(active)
+    {
+        drift(id, pos, vel);
+    }
+}
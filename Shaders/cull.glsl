@@ -0,0 +1,101 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "render_common.glsl"
+
+layout(constant_id = 1) const uint WORKGROUP_SIZE = 256;
+
+layout (local_size_x_id = 1, local_size_y = 1, local_size_z = 1) in;
+
+// particle indices of the visible fish close to the camera, one per instance of the mesh draw
+layout(std430, binding = 7) writeonly buffer NearIndices
+{
+    uint nearIndices[];
+};
+
+// indirect draws of the visible fish, see InstancingRenderer::CullResult
+layout(std430, binding = 8) buffer CullResult
+{
+    // mesh draw of the near fish
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+    // point draw of the far fish, one vertex per fish
+    uint farVertexCount;
+    uint farInstanceCount;
+    uint farFirstVertex;
+    uint farFirstInstance;
+    uint total;
+} cull;
+
+// live particle count as copied into the sharing buffer, see boids_common.glsl
+layout(std430, binding = 9) readonly buffer ParticleCount
+{
+    uint N;
+};
+
+// particle indices of the visible fish beyond the impostor distance, one per vertex of the point draw
+layout(std430, binding = 10) writeonly buffer FarIndices
+{
+    uint farIndices[];
+};
+
+shared uint groupNear;
+shared uint groupFar;
+shared uint groupNearOffset;
+shared uint groupFarOffset;
+
+
+bool insideFrustum(vec3 p, float radius)
+{
+    for(uint i = 0; i < 6; i++)
+    {
+        if(dot(ubo.frustumPlanes[i], vec4(p, 1.0)) < -radius) return false;
+    }
+    return true;
+}
+
+// compacts the indices of the fish inside the view frustum and the draw distance into the near and far lists,
+// one global atomic per workgroup and list reserves the range of its fish
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    uint lid = gl_LocalInvocationID.x;
+    
+    if(lid == 0)
+    {
+        groupNear = 0;
+        groupFar = 0;
+    }
+    barrier();
+    
+    bool visible = false;
+    bool far = false;
+    if(id < N)
+    {
+        vec3 pos = interpolatedPosition(id);
+        vec3 toCamera = pos - ubo.cameraPosition.xyz;
+        float distanceSq = dot(toCamera, toCamera);
+        visible = distanceSq <= ubo.drawDistance * ubo.drawDistance && (ubo.frustumCulling == 0 || insideFrustum(pos, ubo.boundingRadius));
+        far = distanceSq > ubo.impostorDistance * ubo.impostorDistance;
+    }
+    uint slot = 0;
+    if(visible) slot = far ? atomicAdd(groupFar, 1) : atomicAdd(groupNear, 1);
+    barrier();
+    
+    if(lid == 0)
+    {
+        groupNearOffset = atomicAdd(cull.instanceCount, groupNear);
+        groupFarOffset = atomicAdd(cull.farVertexCount, groupFar);
+    }
+    barrier();
+    
+    if(visible)
+    {
+        if(far) farIndices[groupFarOffset + slot] = id;
+        else nearIndices[groupNearOffset + slot] = id;
+    }
+    if(id == 0) cull.total = N;
+}
@@ -0,0 +1,20 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "grid_common.glsl"
+
+layout (local_size_x_id = 1, local_size_y = 1, local_size_z = 1) in;
+
+
+// grid pass 1 : find the cell of every particle and count particles per cell
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if(id >= N) return;
+    
+    uint cell = cellIndex(cellCoord(positionsRead[id].xyz));
+    
+    particleCell[id] = cell;
+    atomicAdd(cellCount[cell], 1);
+}
@@ -0,0 +1,65 @@
+// uniform grid used by the grid_* passes (include after boids_common.glsl)
+
+layout(push_constant) uniform GridParameters
+{
+    uint GRID_DIM;
+    float CELL_SIZE;
+    uint CELL_COUNT;
+    uint STAGE;
+    // verlet_* passes only
+    float LIST_RADIUS;
+    float HALF_SKIN;
+    uint LIST_CAPACITY;
+    uint FORCE_REBUILD;
+    // every flocking pass
+    uint STEP;
+} grid;
+
+// cell index of every particle
+layout(std430, binding = 5) buffer ParticleCell
+{
+    uint particleCell[];
+};
+
+// particles per cell
+layout(std430, binding = 6) buffer CellCount
+{
+    uint cellCount[];
+};
+
+// first slot of every cell in sortedIndices (exclusive prefix sum of cellCount)
+layout(std430, binding = 7) buffer CellStart
+{
+    uint cellStart[];
+};
+
+// scatter cursor per cell
+layout(std430, binding = 8) buffer CellFill
+{
+    uint cellFill[];
+};
+
+// per 256-cell block totals for the prefix sum
+layout(std430, binding = 9) buffer BlockSums
+{
+    uint blockSums[];
+};
+
+// particle indices ordered by cell
+layout(std430, binding = 10) buffer SortedIndices
+{
+    uint sortedIndices[];
+};
+
+
+// positions outside the field are clamped into the border cells,
+// which keeps the 27 cell search exact since clamping never increases distances
+ivec3 cellCoord(vec3 pos)
+{
+    return clamp(ivec3(floor(pos / grid.CELL_SIZE)), ivec3(0), ivec3(int(grid.GRID_DIM) - 1));
+}
+
+uint cellIndex(ivec3 c)
+{
+    return uint(c.x) + grid.GRID_DIM * (uint(c.y) + grid.GRID_DIM * uint(c.z));
+}
@@ -0,0 +1,49 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "grid_common.glsl"
+#include "lod_common.glsl"
+
+layout (local_size_x_id = 1, local_size_y = 1, local_size_z = 1) in;
+
+
+// grid pass 4 : flocking rules, only the 27 cells around the particle are visited
+// CELL_SIZE is never smaller than the largest interaction distance
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if(id >= N) return;
+    
+    vec3 pos = positionsRead[id].xyz;
+    vec3 vel = velocitiesRead[id].xyz;
+    
+    if(!lodDue(id, pos))
+    {
+        drift(id, pos, vel);
+        return;
+    }
+    
+    Neighborhood n = emptyNeighborhood();
+    
+    ivec3 center = cellCoord(pos);
+    int maxCoord = int(grid.GRID_DIM) - 1;
+    
+    for(int z = max(center.z - 1, 0); z <= min(center.z + 1, maxCoord); z++)
+    for(int y = max(center.y - 1, 0); y <= min(center.y + 1, maxCoord); y++)
+    for(int x = max(center.x - 1, 0); x <= min(center.x + 1, maxCoord); x++)
+    {
+        uint cell = cellIndex(ivec3(x, y, z));
+        uint begin = cellStart[cell];
+        uint end = begin + cellCount[cell];
+        
+        for(uint k = begin; k < end; k++)
+        {
+            uint i = sortedIndices[k];
+            addNeighborAt(n, pos, i);
+        }
+    }
+    
+    lodRecord(id, n);
+    integrate(id, pos, vel, n);
+}
@@ -0,0 +1,72 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "grid_common.glsl"
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+// grid pass 2 : exclusive prefix sum of cellCount into cellStart
+//   STAGE 0 : scan each block of 256 cells, write block totals
+//   STAGE 1 : scan the block totals in a single workgroup (up to 256 * BLOCKS_PER_THREAD blocks)
+//   STAGE 2 : add the scanned block totals back to every cell
+
+const uint BLOCKS_PER_THREAD = 4;
+
+shared uint scratch[256];
+
+
+// Hillis-Steele inclusive scan of scratch
+void scanScratch(uint lid)
+{
+    for(uint offset = 1; offset < 256; offset *= 2)
+    {
+        barrier();
+        uint v = lid >= offset ? scratch[lid - offset] : 0;
+        barrier();
+        scratch[lid] += v;
+    }
+    barrier();
+}
+
+void main()
+{
+    uint lid = gl_LocalInvocationID.x;
+    uint gid = gl_GlobalInvocationID.x;
+    uint blockCount = (grid.CELL_COUNT + 255) / 256;
+    
+    if(grid.STAGE == 0)
+    {
+        uint count = gid < grid.CELL_COUNT ? cellCount[gid] : 0;
+        scratch[lid] = count;
+        scanScratch(lid);
+        
+        if(gid < grid.CELL_COUNT) cellStart[gid] = scratch[lid] - count;
+        if(lid == 255) blockSums[gl_WorkGroupID.x] = scratch[255];
+    }
+    else if(grid.STAGE == 1)
+    {
+        uint first = lid * BLOCKS_PER_THREAD;
+        uint sums[BLOCKS_PER_THREAD];
+        uint total = 0;
+        for(uint i = 0; i < BLOCKS_PER_THREAD; i++)
+        {
+            sums[i] = first + i < blockCount ? blockSums[first + i] : 0;
+            total += sums[i];
+        }
+        
+        scratch[lid] = total;
+        scanScratch(lid);
+        
+        uint running = scratch[lid] - total;
+        for(uint i = 0; i < BLOCKS_PER_THREAD; i++)
+        {
+            if(first + i < blockCount) blockSums[first + i] = running;
+            running += sums[i];
+        }
+    }
+    else
+    {
+        if(gid < grid.CELL_COUNT) cellStart[gid] += blockSums[gl_WorkGroupID.x];
+    }
+}
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "grid_common.glsl"
+
+layout (local_size_x_id = 1, local_size_y = 1, local_size_z = 1) in;
+
+
+// grid pass 3 : counting sort, write every particle index into its cell range
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if(id >= N) return;
+    
+    uint cell = particleCell[id];
+    
+    sortedIndices[cellStart[cell] + atomicAdd(cellFill[cell], 1)] = id;
+}
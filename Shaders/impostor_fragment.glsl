@@ -0,0 +1,11 @@
+#version 450
+
+layout(location = 0) in vec3 inColor;
+
+layout(location = 0) out vec4 outColor;
+
+// flat color, no texture fetch and no discard
+void main()
+{
+    outColor = vec4(inColor, 1.0);
+}
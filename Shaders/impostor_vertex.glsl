@@ -0,0 +1,24 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "render_common.glsl"
+
+// particle indices of the visible fish beyond the impostor distance, written by the cull pass
+layout(std430, binding = 10) readonly buffer FarIndices
+{
+    uint farIndices[];
+};
+
+layout(location = 0) out vec3 outFragColor;
+
+
+// one point per far fish, sized to the fish it stands for
+void main()
+{
+    uint id = farIndices[gl_VertexIndex];
+    
+    gl_Position = ubo.proj * ubo.view * vec4(interpolatedPosition(id), 1.0);
+    gl_PointSize = max(ubo.impostorScale / gl_Position.w, 1.0);
+    
+    outFragColor = ubo.impostorColor.rgb;
+}
@@ -0,0 +1,44 @@
+// temporal level of detail used by the flocking passes (include after grid_common.glsl)
+// a particle runs the rules every lodInterval steps and drifts in between, the steps are
+// staggered per workgroup so neighbors in memory share their schedule
+
+const uint LOD_OFF = 0;
+const uint LOD_CAMERA_DISTANCE = 1;
+const uint LOD_NEIGHBOR_COUNT = 2;
+
+// particles within any rule distance at the last update, including the particle itself, 0 before the first one
+// (not permuted by the morton reordering, a stale count only lasts until the next update)
+layout(std430, binding = 21) buffer LodNeighbors
+{
+    uint lodNeighbors[];
+};
+
+
+uint lodInterval(uint id, vec3 pos)
+{
+    if(ubo.LOD_MODE == LOD_CAMERA_DISTANCE)
+    {
+        float beyond = max(length(pos - ubo.LOD_CAMERA.xyz) - ubo.LOD_NEAR_DISTANCE, 0.0);
+        return min(1 + uint(beyond / ubo.LOD_DISTANCE_STEP), ubo.LOD_MAX_INTERVAL);
+    }
+    
+    if(ubo.LOD_MODE == LOD_NEIGHBOR_COUNT && lodNeighbors[id] == 1)
+    {
+        return ubo.LOD_MAX_INTERVAL;
+    }
+    
+    return 1;
+}
+
+bool lodDue(uint id, vec3 pos)
+{
+    return (grid.STEP + id / WORKGROUP_SIZE) % lodInterval(id, pos) == 0;
+}
+
+void lodRecord(uint id, Neighborhood n)
+{
+    if(ubo.LOD_MODE == LOD_NEIGHBOR_COUNT)
+    {
+        lodNeighbors[id] = uint(max(n.attractionNearCnt, max(n.alignmentNearCnt, n.avoidanceNearCnt)));
+    }
+}
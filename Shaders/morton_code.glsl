@@ -0,0 +1,31 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "sort_common.glsl"
+
+layout (local_size_x_id = 1, local_size_y = 1, local_size_z = 1) in;
+
+
+// spreads the lower 10 bits of v so there are two zero bits between each
+uint expandBits(uint v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// reorder pass 1 : 30 bit morton code of every position, 10 bits per axis over the field
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if(id >= N) return;
+    
+    vec3 p = clamp(positionsRead[id].xyz / FIELD_SCALE, 0.0, 1.0) * 1023.0;
+    uvec3 q = uvec3(p);
+    
+    sortKeys[id] = expandBits(q.x) | (expandBits(q.y) << 1) | (expandBits(q.z) << 2);
+    sortValues[id] = id;
+}
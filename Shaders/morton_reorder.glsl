@@ -0,0 +1,22 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "sort_common.glsl"
+
+layout (local_size_x_id = 1, local_size_y = 1, local_size_z = 1) in;
+
+
+// reorder pass 3 : gather every particle stream into morton order
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if(id >= N) return;
+    
+    uint src = sortValues[id];
+    
+    positionsWrite[id] = positionsRead[src];
+    velocitiesWrite[id] = velocitiesRead[src];
+    orientationsWrite[id] = orientationOf(velocitiesRead[src].xyz);
+    colorsScratch[id] = colors[src];
+}
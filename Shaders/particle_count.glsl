@@ -0,0 +1,23 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "sort_common.glsl"
+
+layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+
+
+// group counts of the particle and sort passes, run whenever N may have changed
+// so no pass, the cull pass of the renderer included, needs the count on the host
+void main()
+{
+    N = min(N, CAPACITY);
+    
+    particleDispatch[0] = (N + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+    particleDispatch[1] = 1;
+    particleDispatch[2] = 1;
+    
+    sortDispatch[0] = sortBlockCount();
+    sortDispatch[1] = 1;
+    sortDispatch[2] = 1;
+}
@@ -0,0 +1,92 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "sort_common.glsl"
+
+layout (local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+// reorder pass 2 : one stable LSD radix sort pass over RADIX_BITS bits starting at SHIFT
+//   STAGE 0 : digit histogram of each block of 256 keys
+//   STAGE 1 : exclusive scan of all histograms in a single workgroup
+//   STAGE 2 : stable scatter of keys and values to their scanned offsets
+
+shared uint counts[RADIX];
+shared uint scratch[SORT_BLOCK_SIZE];
+
+
+uint digitOf(uint key)
+{
+    return (key >> sort.SHIFT) & (RADIX - 1);
+}
+
+void main()
+{
+    uint lid = gl_LocalInvocationID.x;
+    uint gid = gl_GlobalInvocationID.x;
+    uint block = gl_WorkGroupID.x;
+    uint blockCount = sortBlockCount();
+    
+    if(sort.STAGE == 0)
+    {
+        if(lid < RADIX) counts[lid] = 0;
+        barrier();
+        
+        if(gid < N) atomicAdd(counts[digitOf(sortKeys[sort.IN_OFFSET + gid])], 1);
+        barrier();
+        
+        if(lid < RADIX) digitOffsets[lid * blockCount + block] = counts[lid];
+    }
+    else if(sort.STAGE == 1)
+    {
+        uint total = RADIX * blockCount;
+        uint chunk = (total + SORT_BLOCK_SIZE - 1) / SORT_BLOCK_SIZE;
+        uint first = lid * chunk;
+        uint last = min(first + chunk, total);
+        
+        uint sum = 0;
+        for(uint i = first; i < last; i++) sum += digitOffsets[i];
+        
+        // Hillis-Steele inclusive scan of the chunk sums
+        scratch[lid] = sum;
+        for(uint offset = 1; offset < SORT_BLOCK_SIZE; offset *= 2)
+        {
+            barrier();
+            uint v = lid >= offset ? scratch[lid - offset] : 0;
+            barrier();
+            scratch[lid] += v;
+        }
+        barrier();
+        
+        uint running = scratch[lid] - sum;
+        for(uint i = first; i < last; i++)
+        {
+            uint count = digitOffsets[i];
+            digitOffsets[i] = running;
+            running += count;
+        }
+    }
+    else
+    {
+        bool active = gid < N;
+        uint key = active ? sortKeys[sort.IN_OFFSET + gid] : 0;
+        uint digit = active ? digitOf(key) : RADIX;
+        
+        scratch[lid] = digit;
+        barrier();
+        
+        if(active)
+        {
+            // rank among the earlier keys of this block with the same digit keeps the sort stable
+            uint rank = 0;
+            for(uint j = 0; j < lid; j++)
+            {
+                if(scratch[j] == digit) rank++;
+            }
+            
+            uint dst = digitOffsets[digit * blockCount + block] + rank;
+            sortKeys[sort.OUT_OFFSET + dst] = key;
+            sortValues[sort.OUT_OFFSET + dst] = sortValues[sort.IN_OFFSET + gid];
+        }
+    }
+}
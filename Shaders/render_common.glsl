@@ -0,0 +1,67 @@
+// shared by the vertex shader and the cull pass of InstancingRenderer (include after #version)
+
+layout(binding = 0) uniform UniformBufferObject
+{
+    mat4 view;
+    mat4 proj;
+    // normalized planes of the view frustum, a point p is inside where dot(plane, vec4(p, 1)) >= 0
+    vec4 frustumPlanes[6];
+    vec4 cameraPosition;
+    // color of the far fish, mean of the opaque texels of the fish texture
+    vec4 impostorColor;
+    float interpolation;
+    // sphere around the position that holds the whole fish
+    float boundingRadius;
+    uint frustumCulling;
+    // fish beyond are drawn as points, beyond drawDistance not at all
+    float impostorDistance;
+    float drawDistance;
+    // point size in pixels at a clip space w of 1
+    float impostorScale;
+} ubo;
+
+// particle state as packed streams of the sharing buffer of the frame, see ParticleLayout.hpp
+// 2-3 : newest state, 5-6 : state before, rendering runs between both
+layout(std430, binding = 2) readonly buffer PositionData
+{
+    vec4 positions[];
+};
+
+// quaternions written by the simulation, xyz vector part and w scalar part
+layout(std430, binding = 3) readonly buffer OrientationData
+{
+    vec4 orientations[];
+};
+
+layout(std430, binding = 4) readonly buffer ColorData
+{
+    vec4 colors[];
+};
+
+layout(std430, binding = 5) readonly buffer PreviousPositionData
+{
+    vec4 previousPositions[];
+};
+
+layout(std430, binding = 6) readonly buffer PreviousOrientationData
+{
+    vec4 previousOrientations[];
+};
+
+// specialization constants, see ShaderConstants.hpp
+layout(constant_id = 2) const float FIELD_SCALE = 1.0;
+layout(constant_id = 8) const float FISH_SCALE = 0.035;
+
+
+vec3 interpolatedPosition(uint id)
+{
+    return mix(previousPositions[id].xyz, positions[id].xyz, ubo.interpolation);
+}
+
+// normalized lerp along the shorter arc, close enough to slerp for the small turn of one step
+vec4 interpolatedOrientation(uint id)
+{
+    vec4 from = previousOrientations[id];
+    vec4 to = orientations[id];
+    return normalize(mix(from, dot(from, to) < 0.0 ? -to : to, ubo.interpolation));
+}
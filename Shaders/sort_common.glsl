@@ -0,0 +1,47 @@
+// morton reordering used by morton_code, radix_sort and morton_reorder (include after boids_common.glsl)
+
+layout(push_constant) uniform SortParameters
+{
+    uint STAGE;
+    uint SHIFT;
+    uint IN_OFFSET;
+    uint OUT_OFFSET;
+} sort;
+
+layout(std430, binding = 11) readonly buffer ColorData
+{
+    vec4 colors[];
+};
+
+// colors in the new order, copied back over colors afterwards
+layout(std430, binding = 12) writeonly buffer ColorScratch
+{
+    vec4 colorsScratch[];
+};
+
+// two halves of CAPACITY keys / values, the radix sort ping-pongs between them
+layout(std430, binding = 13) buffer SortKeys
+{
+    uint sortKeys[];
+};
+
+layout(std430, binding = 14) buffer SortValues
+{
+    uint sortValues[];
+};
+
+// digit-major block histograms, exclusive scanned into scatter offsets
+layout(std430, binding = 15) buffer DigitOffsets
+{
+    uint digitOffsets[];
+};
+
+const uint RADIX_BITS = 4;
+const uint RADIX = 1 << RADIX_BITS;
+const uint SORT_BLOCK_SIZE = 256;
+
+// blocks of the live particles, the digit offsets are laid out by it
+uint sortBlockCount()
+{
+    return (N + SORT_BLOCK_SIZE - 1) / SORT_BLOCK_SIZE;
+}
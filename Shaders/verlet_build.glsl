@@ -0,0 +1,51 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "grid_common.glsl"
+#include "verlet_common.glsl"
+
+layout (local_size_x_id = 1, local_size_y = 1, local_size_z = 1) in;
+
+
+// verlet pass 3 (rebuild only) : list every particle within LIST_RADIUS using the uniform grid,
+// CELL_SIZE is never smaller than LIST_RADIUS
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if(id >= N) return;
+    
+    vec3 pos = positionsRead[id].xyz;
+    float radius2 = grid.LIST_RADIUS * grid.LIST_RADIUS;
+    uint base = id * grid.LIST_CAPACITY;
+    uint count = 0;
+    
+    ivec3 center = cellCoord(pos);
+    int maxCoord = int(grid.GRID_DIM) - 1;
+    
+    for(int z = max(center.z - 1, 0); z <= min(center.z + 1, maxCoord); z++)
+    for(int y = max(center.y - 1, 0); y <= min(center.y + 1, maxCoord); y++)
+    for(int x = max(center.x - 1, 0); x <= min(center.x + 1, maxCoord); x++)
+    {
+        uint cell = cellIndex(ivec3(x, y, z));
+        uint begin = cellStart[cell];
+        uint end = begin + cellCount[cell];
+        
+        for(uint k = begin; k < end; k++)
+        {
+            uint i = sortedIndices[k];
+            vec3 d = positionsRead[i].xyz - pos;
+            if(dot(d, d) >= radius2) continue;
+            
+            if(count < grid.LIST_CAPACITY) neighborList[base + count] = i;
+            count++;
+        }
+    }
+    
+    // neighbors past the capacity are dropped
+    if(count > grid.LIST_CAPACITY) atomicAdd(verlet.overflowCount, 1);
+    atomicMax(verlet.maxNeighborCount, count);
+    
+    neighborCount[id] = min(count, grid.LIST_CAPACITY);
+    referencePositions[id] = vec4(pos, 1.0);
+}
@@ -0,0 +1,36 @@
+// verlet neighbor lists used by the verlet_* passes (include after grid_common.glsl)
+
+// counters read back by the host, maxDisplacement holds the float bits of the largest
+// distance a particle moved since the last rebuild
+layout(std430, binding = 16) buffer VerletState
+{
+    uint stepCount;
+    uint rebuildCount;
+    uint overflowCount;
+    uint maxNeighborCount;
+    uint maxDisplacement;
+} verlet;
+
+// valid entries of every list
+layout(std430, binding = 17) buffer NeighborCount
+{
+    uint neighborCount[];
+};
+
+// LIST_CAPACITY particle indices per particle
+layout(std430, binding = 18) buffer NeighborList
+{
+    uint neighborList[];
+};
+
+// positions at the last rebuild
+layout(std430, binding = 19) buffer ReferencePosition
+{
+    vec4 referencePositions[];
+};
+
+// VkDispatchIndirectCommand of the rebuild passes : particle groups, cell groups, single group
+layout(std430, binding = 20) buffer DispatchArgs
+{
+    uint dispatchArgs[];
+};
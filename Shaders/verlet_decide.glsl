@@ -0,0 +1,32 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "grid_common.glsl"
+#include "verlet_common.glsl"
+
+layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+
+
+// verlet pass 2 : rebuild once some particle moved more than half the skin,
+// the rebuild passes are dispatched indirectly with zero groups otherwise
+void main()
+{
+    bool rebuild = grid.FORCE_REBUILD != 0 || uintBitsToFloat(verlet.maxDisplacement) > grid.HALF_SKIN;
+    
+    verlet.stepCount++;
+    verlet.maxDisplacement = 0;
+    if(rebuild) verlet.rebuildCount++;
+    
+    uint particleGroups = rebuild ? (N + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE : 0;
+    uint cellGroups = rebuild ? (grid.CELL_COUNT + 255) / 256 : 0;
+    uint singleGroup = rebuild ? 1 : 0;
+    
+    uint groups[3] = uint[](particleGroups, cellGroups, singleGroup);
+    for(uint i = 0; i < 3; i++)
+    {
+        dispatchArgs[i * 3 + 0] = groups[i];
+        dispatchArgs[i * 3 + 1] = 1;
+        dispatchArgs[i * 3 + 2] = 1;
+    }
+}
@@ -0,0 +1,30 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "grid_common.glsl"
+#include "verlet_common.glsl"
+
+layout (local_size_x_id = 1, local_size_y = 1, local_size_z = 1) in;
+
+shared uint groupMax;
+
+
+// verlet pass 1 : largest displacement since the last rebuild
+// non-negative floats compare like their bit patterns, so atomicMax works on the raw bits
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    
+    if(gl_LocalInvocationID.x == 0) groupMax = 0;
+    barrier();
+    
+    if(id < N)
+    {
+        float displacement = length(positionsRead[id].xyz - referencePositions[id].xyz);
+        atomicMax(groupMax, floatBitsToUint(displacement));
+    }
+    barrier();
+    
+    if(gl_LocalInvocationID.x == 0) atomicMax(verlet.maxDisplacement, groupMax);
+}
@@ -0,0 +1,38 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "boids_common.glsl"
+#include "grid_common.glsl"
+#include "verlet_common.glsl"
+#include "lod_common.glsl"
+
+layout (local_size_x_id = 1, local_size_y = 1, local_size_z = 1) in;
+
+
+// verlet pass 4 : flocking rules over the cached list
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if(id >= N) return;
+    
+    vec3 pos = positionsRead[id].xyz;
+    vec3 vel = velocitiesRead[id].xyz;
+    
+    if(!lodDue(id, pos))
+    {
+        drift(id, pos, vel);
+        return;
+    }
+    
+    Neighborhood n = emptyNeighborhood();
+    
+    uint base = id * grid.LIST_CAPACITY;
+    uint count = neighborCount[id];
+    for(uint k = 0; k < count; k++)
+    {
+        addNeighborAt(n, pos, neighborList[base + k]);
+    }
+    
+    lodRecord(id, n);
+    integrate(id, pos, vel, n);
+}
@@ -8,19 +8,46 @@
 
 void App::Run()
 {
-    InitWindow();
+    if(settings.runKernelBenchmark)
+    {
+        RunKernelBenchmark();
+        return;
+    }
+    
+    if(!settings.headless) InitWindow();
     InitVulkan();
     
     
-    imGuiWrapper.Init(window, instance, device,  physicalDevice, renderPass, instancingQueue, commandPool);
+    if(!settings.headless) imGuiWrapper.Init(window, instance, device,  physicalDevice, renderPass, instancingQueue, commandPool);
     
-    computeShader.Init(&device, &physicalDevice, N, sharingBuffers, &commandPool);
+    computeShader.hostSharing = settings.cpuSimulation && !settings.runBenchmark;
+    computeShader.Init(&device, &physicalDevice, MakeShaderConstants(), framesInFlight, stateBuffers, colorBuffer, &computeCommandPool, &computeQueue, computeFamily, graphicsFamily);
+    computeShader.SetParticleCount(N);
+    cpuSimulator.Init(MakeShaderConstants());
     
-    instancingRenderer.Init(&device, &physicalDevice, &renderPass, &commandPool, &instancingQueue, N, sharingBuffers);
+    instancingRenderer.Init(&device, &physicalDevice, &renderPass, &commandPool, &instancingQueue, MakeShaderConstants(), computeShader.GetSharingBuffers(), computeFamily, graphicsFamily);
+    instancingRenderer.viewportHeight = (float)swapChainExtent.height;
+    
+    if(settings.warmUpSteps > 0)
+    {
+        ConfigureSimulator(computeShader);
+        computeShader.SetAdvanceBatchSize(STEPS_PER_SUBMISSION);
+        computeShader.Advance(settings.warmUpSteps);
+    }
+    
+    if(settings.cpuSimulation && !settings.runBenchmark)
+    {
+        instancingRenderer.hostSharing = true;
+        LoadCpuState();
+        simulationThread.Start(&cpuSimulator, MakeSimulationSettings());
+    }
     
     
     // loop every frame
-    MainLoop();
+    if(settings.runBenchmark) RunBenchmark();
+    else MainLoop();
+    
+    StopSimulationThread();
     
     Finalize();
 }
@@ -28,39 +55,540 @@ void App::Run()
 
 void App::MainLoop()
 {
-    while (!glfwWindowShouldClose(window))
+    lastFrameTime = Time();
+    double startTime = lastFrameTime;
+    uint32_t frameCount = 0;
+    
+    while (settings.headless ? frameCount < settings.frameCount : !glfwWindowShouldClose(window))
     {
         // frame polling and input
-        glfwPollEvents();
-        if(glfwGetKey(window, GLFW_KEY_ESCAPE))break;
+        if(!settings.headless)
+        {
+            glfwPollEvents();
+            if(glfwGetKey(window, GLFW_KEY_ESCAPE))break;
+        }
         
+        if(resizeRequested)
+        {
+            // the cpu state goes through the state buffers, which keep the fish and spawn the new ones
+            bool cpu = simulationThread.IsRunning();
+            if(cpu)
+            {
+                StopSimulationThread();
+                StoreCpuState();
+            }
+            SetParticleCount((uint32_t)requestedN);
+            if(cpu)
+            {
+                LoadCpuState();
+                simulationThread.Start(&cpuSimulator, MakeSimulationSettings());
+            }
+            resizeRequested = false;
+        }
         
-        // execute compute shader
-        ParticleParameters p;
-        p.MAX_SPEED = MAX_SPEED / PARAM_MULTIPLY;
-        p.ATTRACTION = ATTRACTION / PARAM_MULTIPLY;
-        p.WALL_AVOIDANCE = WALL_AVOIDANCE / PARAM_MULTIPLY;
-        p.ATTRACTION_DISTANCE = ATTRACTION_DISTANCE;
-        p.ALIGNMENT_DISTANCE = ALIGNMENT_DISTANCE;
-        p.ALIGNMENT = ALIGNMENT / PARAM_MULTIPLY;
-        p.AVOIDANCE_DISTANCE = AVOIDANCE_DISTANCE;
-        p.AVOIDANCE = AVOIDANCE / PARAM_MULTIPLY;
-        p.VORTEX_FORCE = VORTEX_FORCE / PARAM_MULTIPLY;
-        computeShader.SetParameters(p);
+        ApplySimulationParameters();
         
-        computeShader.Execute(frameIndex, &computeSemaphores[frameIndex], &computeFences[frameIndex], computeQueue);
+        if(fastForwardRequested)
+        {
+            computeShader.SetAdvanceBatchSize(STEPS_PER_SUBMISSION);
+            computeShader.Advance(FAST_FORWARD_STEPS);
+            fastForwardRequested = false;
+            // the time spent fast-forwarding is not owed to the fixed tick
+            lastFrameTime = Time();
+        }
         
+        if(cpuCheckRequested)
+        {
+            CheckAgainstCpu();
+            cpuCheckRequested = false;
+            lastFrameTime = Time();
+        }
         
-        // render instanced fish and GUI
-        RenderBegin();
+        Frame(SimulationSteps());
+        frameCount++;
         
-        instancingRenderer.Draw(frameIndex, commandBuffers[frameIndex]);
-        RenderGUI();
+        // the simulation thread hashes its own steps, see StopSimulationThread
+        if(settings.deterministic && !simulationThread.IsRunning()) RecordStateHash(computeShader.GetStepCount(), HashGpuState());
+    }
+
+    vkDeviceWaitIdle(device);
+    
+    bool cpu = simulationThread.IsRunning();
+    StopSimulationThread();
+    if(!settings.profileOutput.empty()) profiler.ExportCSV(settings.profileOutput);
+    if(!settings.hashOutput.empty() && !WriteStateHashes(settings.hashOutput)) printf("could not write %s\n", settings.hashOutput.c_str());
+    if(settings.headless)
+    {
+        double elapsed = Time() - startTime;
+        printf("%u frames, %u fishes, %.3f s, %.1f fps\n", frameCount, N, elapsed, elapsed > 0.0 ? frameCount / elapsed : 0.0);
+        if(cpu)
+        {
+            printf("cpu simulation: %llu steps, %llu dropped, %llu duplicated\n", (unsigned long long)simulationThread.Newest().step,
+                   (unsigned long long)simulationThread.GetDroppedCount(), (unsigned long long)simulationThread.GetDuplicatedCount());
+        }
+        if(!stateHashes.empty())
+        {
+            printf("step %llu, state hash %016llx\n", (unsigned long long)stateHashes.back().first, (unsigned long long)stateHashes.back().second);
+        }
+    }
+}
+
+
+// every case starts from the same fish and runs warm-up frames before the measured ones, one step per frame
+void App::RunBenchmark()
+{
+    const Benchmark& benchmark = settings.benchmark;
+    
+    BenchmarkCase defaults;
+    defaults.fishCount = N;
+    defaults.workgroupSize = WORKGROUP_SIZE;
+    defaults.attractionDistance = ATTRACTION_DISTANCE;
+    defaults.alignmentDistance = ALIGNMENT_DISTANCE;
+    defaults.avoidanceDistance = AVOIDANCE_DISTANCE;
+    defaults.neighborSearch = computeShader.GetNeighborSearch();
+    
+    std::vector<BenchmarkResult> results;
+    for (const BenchmarkCase& config : benchmark.Cases(defaults))
+    {
+        if(!IsWorkgroupSizeSupported(config.workgroupSize))
+        {
+            fprintf(stderr, "skipping workgroup size %u, this device supports powers of two from 32 to %u\n", config.workgroupSize, MaxWorkgroupSize());
+            continue;
+        }
+        if(!IsNeighborSearchSupported(config.neighborSearch))
+        {
+            fprintf(stderr, "skipping the verlet list, it is not deterministic\n");
+            continue;
+        }
+        
+        WORKGROUP_SIZE = config.workgroupSize;
+        ATTRACTION_DISTANCE = config.attractionDistance;
+        ALIGNMENT_DISTANCE = config.alignmentDistance;
+        AVOIDANCE_DISTANCE = config.avoidanceDistance;
+        computeShader.SetNeighborSearch(config.neighborSearch);
+        SetParticleCount(config.fishCount);
+        
+        vkDeviceWaitIdle(device);
+        rndEngine.seed(benchmark.GetSeed());
+        SpawnParticles(0, N);
+        computeShader.ResetState();
+        ApplySimulationParameters();
         
-        RenderEnd();
+        for (uint32_t frame = 0; frame < benchmark.GetWarmupFrames(); frame++) Frame(1);
+        
+        std::vector<double> frameMs;
+        double simulationMs = 0.0;
+        double renderMs = 0.0;
+        double frameStart = Time();
+        // the gpu times of a slot are read back when the slot is reused, they only count if a measured frame produced them
+        std::vector<bool> measuredSlots(framesInFlight, false);
+        for (uint32_t frame = 0; frame < settings.frameCount; frame++)
+        {
+            uint32_t slot = frameIndex;
+            Frame(1);
+            
+            if(measuredSlots[slot])
+            {
+                simulationMs += computeShader.GetPassMilliseconds(ComputeShader::STEPS_PASS);
+                renderMs += renderTimer.GetMilliseconds(RENDER_FRAME);
+            }
+            measuredSlots[slot] = true;
+            
+            double now = Time();
+            frameMs.push_back((now - frameStart) * 1000.0);
+            frameStart = now;
+        }
+        vkDeviceWaitIdle(device);
+        
+        // the last frame of every slot is never reused within the case
+        for (uint32_t slot = 0; slot < framesInFlight; slot++)
+        {
+            if(!measuredSlots[slot]) continue;
+            computeShader.CollectPassTimes(slot);
+            renderTimer.Collect(slot);
+            simulationMs += computeShader.GetPassMilliseconds(ComputeShader::STEPS_PASS);
+            renderMs += renderTimer.GetMilliseconds(RENDER_FRAME);
+        }
+        
+        BenchmarkCase measured = config;
+        measured.fishCount = N;
+        results.push_back(Benchmark::Summarize(measured, frameMs, simulationMs, renderMs));
+    }
+    
+    benchmark.Write(results);
+}
+
+
+// every supported instruction set on the same fish SpawnParticles spawns from the benchmark seed (colors unused),
+// one thread so the numbers compare the kernels rather than the core count
+void App::RunKernelBenchmark()
+{
+    const Benchmark& benchmark = settings.benchmark;
+    
+    BenchmarkCase defaults;
+    defaults.fishCount = N;
+    defaults.workgroupSize = WORKGROUP_SIZE;
+    defaults.attractionDistance = ATTRACTION_DISTANCE;
+    defaults.alignmentDistance = ALIGNMENT_DISTANCE;
+    defaults.avoidanceDistance = AVOIDANCE_DISTANCE;
+    defaults.neighborSearch = NeighborSearch::BruteForce;
+    
+    std::vector<KernelBenchmarkResult> results;
+    for (const BenchmarkCase& config : benchmark.Cases(defaults))
+    {
+        rndEngine.seed(benchmark.GetSeed());
+        
+        std::vector<glm::vec4> positions(config.fishCount);
+        std::vector<glm::vec4> velocities(config.fishCount);
+        glm::vec4 color;
+        for (uint32_t i = 0; i < config.fishCount; i++) SpawnFish(positions[i], velocities[i], color);
+        
+        NeighborStreams streams;
+        streams.Resize(config.fishCount);
+        streams.Load(positions.data(), velocities.data(), 0, config.fishCount);
+        
+        NeighborRules rules;
+        rules.attractionDistance = config.attractionDistance;
+        rules.alignmentDistance = config.alignmentDistance;
+        rules.avoidanceDistance = config.avoidanceDistance;
+        
+        double scalarRate = 0.0;
+        for (uint32_t isa = 0; isa < (uint32_t)NeighborKernel::Isa::Count; isa++)
+        {
+            if(!NeighborKernel::IsSupported((NeighborKernel::Isa)isa)) continue;
+            NeighborKernel::Function kernel = NeighborKernel::Get((NeighborKernel::Isa)isa);
+            
+            // the counts keep the loop from being optimized away
+            uint64_t nearCount = 0;
+            auto step = [&]()
+            {
+                for (uint32_t i = 0; i < config.fishCount; i++)
+                {
+                    Neighborhood n;
+                    kernel(streams, 0, config.fishCount, glm::vec3(positions[i]), rules, n);
+                    nearCount += n.attractionNearCnt + n.alignmentNearCnt + n.avoidanceNearCnt;
+                }
+            };
+            
+            step();
+            uint32_t stepCount = 0;
+            double start = Time();
+            double elapsed = 0.0;
+            while(stepCount == 0 || elapsed < KERNEL_BENCHMARK_SECONDS)
+            {
+                step();
+                stepCount++;
+                elapsed = Time() - start;
+            }
+            
+            KernelBenchmarkResult result;
+            result.config = config;
+            result.isa = (NeighborKernel::Isa)isa;
+            result.stepCount = stepCount;
+            result.interactionsPerSecond = (double)config.fishCount * config.fishCount * stepCount / elapsed;
+            if(result.isa == NeighborKernel::Isa::Scalar) scalarRate = result.interactionsPerSecond;
+            result.speedup = scalarRate > 0.0 ? result.interactionsPerSecond / scalarRate : 0.0;
+            results.push_back(result);
+            
+            if(nearCount == 0) fprintf(stderr, "%s: no fish within any rule distance\n", NeighborKernel::Name(result.isa));
+        }
+    }
+    
+    benchmark.Write(results);
+}
+
+
+// rebuilds the pipelines when a rule was switched on or off
+void App::ApplySimulationParameters()
+{
+    ConfigureSimulator(computeShader);
+    instancingRenderer.SetShaderConstants(MakeShaderConstants());
+    if(simulationThread.IsRunning()) simulationThread.SetSettings(MakeSimulationSettings());
+}
+
+
+// the GUI values any simulation backend runs with
+void App::ConfigureSimulator(BoidSimulator& simulator)
+{
+    simulator.SetParameters(MakeParticleParameters());
+    simulator.SetLodParameters(MakeLodParameters());
+    simulator.SetShaderConstants(MakeShaderConstants());
+}
+
+
+// loads the newest gpu state into the cpu simulator, runs one step on both and compares the positions,
+// they only match closely with brute force search and no morton reordering, since the other searches sum neighbors in another order
+// and the reordering permutes the particles, and with NeighborCount lod the cpu starts without the gpu history
+void App::CheckAgainstCpu()
+{
+    vkDeviceWaitIdle(device);
+    LoadCpuState();
+    
+    computeShader.SetAdvanceBatchSize(1);
+    computeShader.Advance(1);
+    cpuSimulator.Advance(1);
+    
+    uint32_t count = computeShader.GetParticleCount();
+    VkDeviceSize positionOffset = ParticleLayout::StreamOffset(ParticleLayout::POSITION, particleCapacity);
+    
+    void* data;
+    VkDeviceMemory after = stateBuffersMemory[computeShader.GetStateIndex()];
+    vkMapMemory(device, after, 0, VK_WHOLE_SIZE, 0, &data);
+    const glm::vec4* gpuPositions = (glm::vec4*)((char*)data + positionOffset);
+    const std::vector<glm::vec4>& cpuPositions = cpuSimulator.GetPositions();
+    cpuCheckDeviation = 0.0f;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        cpuCheckDeviation = std::max(cpuCheckDeviation, glm::length(glm::vec3(gpuPositions[i]) - glm::vec3(cpuPositions[i])));
     }
+    vkUnmapMemory(device, after);
+}
+
+
+// the newest gpu state buffer into the cpu simulator, which starts over from it, the device must be idle
+void App::LoadCpuState()
+{
+    ConfigureSimulator(cpuSimulator);
+    cpuSimulator.SetCellList(CPU_CELL_LIST);
+    cpuSimulator.ResetState();
+    
+    void* data;
+    VkDeviceMemory memory = stateBuffersMemory[computeShader.GetStateIndex()];
+    vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+    const glm::vec4* positions = (glm::vec4*)((char*)data + ParticleLayout::StreamOffset(ParticleLayout::POSITION, particleCapacity));
+    const glm::vec4* velocities = (glm::vec4*)((char*)data + ParticleLayout::StreamOffset(ParticleLayout::VELOCITY, particleCapacity));
+    cpuSimulator.SetState(positions, velocities, computeShader.GetParticleCount(), computeShader.GetStepCount());
+    vkUnmapMemory(device, memory);
+}
+
 
+// the cpu state back into the newest gpu state buffer, the simulation thread must be stopped
+void App::StoreCpuState()
+{
     vkDeviceWaitIdle(device);
+    
+    void* data;
+    VkDeviceMemory memory = stateBuffersMemory[computeShader.GetStateIndex()];
+    vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+    size_t size = sizeof(glm::vec4) * cpuSimulator.GetParticleCount();
+    memcpy((char*)data + ParticleLayout::StreamOffset(ParticleLayout::POSITION, particleCapacity), cpuSimulator.GetPositions().data(), size);
+    memcpy((char*)data + ParticleLayout::StreamOffset(ParticleLayout::VELOCITY, particleCapacity), cpuSimulator.GetVelocities().data(), size);
+    memcpy((char*)data + ParticleLayout::StreamOffset(ParticleLayout::ORIENTATION, particleCapacity), cpuSimulator.GetOrientations().data(), size);
+    vkUnmapMemory(device, memory);
+}
+
+
+// the newest step the simulation thread published into the sharing buffer of this frame, once RenderBegin waited for its last use,
+// the renderer moves from the step before it to it over one tick of the simulation rate
+void App::UploadCpuState()
+{
+    double begin = Time();
+    simulationThread.AcquireNewest();
+    const SimulationSnapshot& snapshot = simulationThread.Newest();
+    
+    char* sharing = (char*)computeShader.GetSharingBuffersMapped()[frameIndex];
+    VkDeviceSize streamSize = ParticleLayout::StreamSize(particleCapacity);
+    size_t size = sizeof(glm::vec4) * snapshot.count;
+    memcpy(sharing + streamSize * ParticleLayout::NEWEST_POSITION, snapshot.positions.data(), size);
+    memcpy(sharing + streamSize * ParticleLayout::NEWEST_ORIENTATION, snapshot.orientations.data(), size);
+    memcpy(sharing + streamSize * ParticleLayout::PREVIOUS_POSITION, snapshot.previousPositions.data(), size);
+    memcpy(sharing + streamSize * ParticleLayout::PREVIOUS_ORIENTATION, snapshot.previousOrientations.data(), size);
+    memcpy(sharing + streamSize * ParticleLayout::COLOR, hostColors.data(), size);
+    
+    // the renderer only reads the count and the cull dispatch
+    ParticleLayout::ParticleCount count{};
+    count.N = snapshot.count;
+    count.particleDispatch = { (snapshot.count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1 };
+    memcpy(sharing + ParticleLayout::SharedCountOffset(particleCapacity), &count, sizeof(count));
+    
+    simulationInterpolation = (float)std::clamp((Time() - snapshot.time) * SIMULATION_RATE, 0.0, 1.0);
+    cpuUploadMs = (Time() - begin) * 1000.0;
+}
+
+
+// the simulation thread logs the hash of every step, the frames only draw some of them
+void App::StopSimulationThread()
+{
+    if(!simulationThread.IsRunning()) return;
+    
+    simulationThread.Stop();
+    for (const std::pair<uint64_t, uint64_t>& entry : simulationThread.GetStateHashes()) RecordStateHash(entry.first, entry.second);
+}
+
+
+// a frame without a step adds nothing
+void App::RecordStateHash(uint64_t step, uint64_t hash)
+{
+    if(!stateHashes.empty() && stateHashes.back().first == step) return;
+    stateHashes.emplace_back(step, hash);
+}
+
+
+// StateHash of the newest gpu state, waits for the compute submission that writes it (made visible to the host
+// by the barrier RecordSteps ends with in deterministic mode), so the cpu and gpu run one after the other every frame
+uint64_t App::HashGpuState()
+{
+    computeShader.GetTimeline().Wait(computeShader.GetTimeline().Pending());
+    
+    void* data;
+    VkDeviceMemory memory = stateBuffersMemory[computeShader.GetStateIndex()];
+    VkResult result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+    assert(result == VK_SUCCESS);
+    (void)result;
+    const glm::vec4* positions = (glm::vec4*)((char*)data + ParticleLayout::StreamOffset(ParticleLayout::POSITION, particleCapacity));
+    const glm::vec4* velocities = (glm::vec4*)((char*)data + ParticleLayout::StreamOffset(ParticleLayout::VELOCITY, particleCapacity));
+    uint64_t hash = StateHash::Of(positions, velocities, computeShader.GetParticleCount());
+    vkUnmapMemory(device, memory);
+    return hash;
+}
+
+
+bool App::WriteStateHashes(const std::string& path) const
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if(!file) return false;
+    
+    fprintf(file, "step,hash\n");
+    for (const std::pair<uint64_t, uint64_t>& entry : stateHashes)
+    {
+        fprintf(file, "%llu,%016llx\n", (unsigned long long)entry.first, (unsigned long long)entry.second);
+    }
+    fclose(file);
+    return true;
+}
+
+
+SimulationSettings App::MakeSimulationSettings() const
+{
+    SimulationSettings simulation;
+    simulation.params = MakeParticleParameters();
+    simulation.lod = MakeLodParameters();
+    simulation.constants = MakeShaderConstants();
+    simulation.rate = SIMULATION_RATE;
+    simulation.cellList = CPU_CELL_LIST;
+    return simulation;
+}
+
+
+// simulates stepCount ticks and renders them
+void App::Frame(uint32_t stepCount)
+{
+    // the transfers of the compute submission wait for the frame that last drew from the sharing buffer it overwrites
+    // (see ComputeShader::Submit), the cpu goes on recording while the frame submitted just before keeps rendering
+    bool cpu = simulationThread.IsRunning();
+    uint32_t slot = frameIndex;
+    if(!cpu) computeShader.Execute(frameIndex, stepCount, graphicsTimeline.Get(), frameValues[frameIndex]);
+    
+    
+    // render instanced fish and GUI
+    RenderBegin();
+    if(cpu) UploadCpuState();
+    ApplyRenderParameters();
+    renderTimer.Begin(commandBuffers[frameIndex], frameIndex, RENDER_CULL);
+    instancingRenderer.Cull(frameIndex, simulationInterpolation, commandBuffers[frameIndex]);
+    renderTimer.End(commandBuffers[frameIndex], frameIndex, RENDER_CULL);
+    RenderPassBegin();
+    
+    renderTimer.Begin(commandBuffers[frameIndex], frameIndex, RENDER_DRAW);
+    instancingRenderer.Draw(frameIndex, commandBuffers[frameIndex]);
+    renderTimer.End(commandBuffers[frameIndex], frameIndex, RENDER_DRAW);
+    if(!settings.headless)
+    {
+        renderTimer.Begin(commandBuffers[frameIndex], frameIndex, RENDER_GUI);
+        RenderGUI();
+        renderTimer.End(commandBuffers[frameIndex], frameIndex, RENDER_GUI);
+    }
+    
+    RenderEnd();
+    
+    // the gpu times read back this frame are those of the frame that last used this slot, which completes its row
+    ProfiledFrame& profiled = profiledFrames[slot];
+    if(profiled.frameMs >= 0.0)
+    {
+        profiler.AddFrame(profiled.frameMs,
+        {
+            profiled.simulationMs >= 0.0 ? profiled.simulationMs : computeShader.GetPassMilliseconds(ComputeShader::STEPS_PASS),
+            profiled.sharingMs >= 0.0 ? profiled.sharingMs : computeShader.GetPassMilliseconds(ComputeShader::SHARING_PASS),
+            renderTimer.GetMilliseconds(RENDER_CULL),
+            renderTimer.GetMilliseconds(RENDER_DRAW),
+            renderTimer.GetMilliseconds(RENDER_GUI)
+        });
+    }
+    
+    double now = Time();
+    profiled = ProfiledFrame();
+    if(profilerFrameTime > 0.0)
+    {
+        profiled.frameMs = (now - profilerFrameTime) * 1000.0;
+        if(cpu)
+        {
+            profiled.simulationMs = simulationThread.Newest().buildMs + simulationThread.Newest().queryMs;
+            profiled.sharingMs = cpuUploadMs;
+        }
+    }
+    profilerFrameTime = now;
+}
+
+
+// ticks due since the last frame, rendering then lags the simulation by less than one tick
+uint32_t App::SimulationSteps()
+{
+    // headless runs are not paced by the clock
+    if(settings.headless)
+    {
+        simulationInterpolation = 0.0f;
+        return 1;
+    }
+    
+    double now = Time();
+    simulationTime += now - lastFrameTime;
+    lastFrameTime = now;
+    
+    double tick = 1.0 / SIMULATION_RATE;
+    uint32_t steps = (uint32_t)(simulationTime / tick);
+    if(steps > (uint32_t)MAX_CATCH_UP_STEPS)
+    {
+        steps = MAX_CATCH_UP_STEPS;
+        simulationTime = std::fmod(simulationTime, tick);
+    }
+    else
+    {
+        simulationTime -= steps * tick;
+    }
+    
+    simulationInterpolation = (float)(simulationTime / tick);
+    return steps;
+}
+
+
+// seconds, glfw is not initialized in headless runs
+double App::Time() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// largest workgroup size this device runs, the tiled kernel keeps two vec3 per invocation in shared memory
+uint32_t App::MaxWorkgroupSize() const
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    uint32_t maxWorkgroupSize = std::min(properties.limits.maxComputeWorkGroupSize[0], properties.limits.maxComputeWorkGroupInvocations);
+    return std::min(maxWorkgroupSize, properties.limits.maxComputeSharedMemorySize / (uint32_t)(2 * sizeof(glm::vec4)));
+}
+
+
+// the sizes the GUI offers, a power of two from 32 up
+bool App::IsWorkgroupSizeSupported(uint32_t size) const
+{
+    return size >= 32 && (size & (size - 1)) == 0 && size <= MaxWorkgroupSize();
+}
+
+
+// a verlet list that overflows LIST_CAPACITY keeps the neighbors the grid scatter reached first, which depends on the gpu scheduling
+bool App::IsNeighborSearchSupported(NeighborSearch mode) const
+{
+    return !(settings.deterministic && mode == NeighborSearch::VerletList);
 }
 
 
@@ -76,30 +604,42 @@ void App::InitWindow()
 void App::InitVulkan()
 {
     InitInstance();
-    InitSurface();
+    if(!settings.headless) InitSurface();
     InitPhysicalDevice();
     InitLogicalDevice();
-    InitSwapChain();
+    if(settings.headless) InitOffscreenImages();
+    else InitSwapChain();
     
     InitImageViews();
     InitRenderPass();
     InitCommandPool();
-    InitSharingBuffers();
+    InitStateBuffers();
     InitDepthImage();
     InitFramebuffers();
     InitCommandBuffers();
-    InitFenceAndSemaphores();
+    InitSemaphores();
+    renderTimer.Init(&device, &physicalDevice, graphicsFamily, framesInFlight, RENDER_SECTION_COUNT);
+    profiler.Init({ "simulation", "sharing", "cull", "draw", "gui" });
+    if(!settings.profileOutput.empty()) profiler.SetExportPath(settings.profileOutput);
+    profiledFrames.assign(framesInFlight, ProfiledFrame());
 }
 
 
 void App::InitInstance()
 {
+    // timeline semaphores are core in 1.2
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "Vulkan Fish";
+    appInfo.apiVersion = VK_API_VERSION_1_2;
+    
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    createInfo.pApplicationInfo = &appInfo;
     
+    // surface extensions only with a window
     uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    const char** glfwExtensions = settings.headless ? nullptr : glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
     std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
     extensions.emplace_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
  
@@ -137,33 +677,86 @@ void App::InitPhysicalDevice()
 
 void App::InitLogicalDevice()
 {
-    VkDeviceQueueCreateInfo queueCreateInfo{};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = 0;
-    queueCreateInfo.queueCount = 1;
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+    
+    // first family that draws and presents, or only draws when headless
+    graphicsFamily = familyCount;
+    for (uint32_t i = 0; i < familyCount && graphicsFamily == familyCount; i++)
+    {
+        VkBool32 presentSupport = settings.headless;
+        if(!settings.headless) vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
+        if((families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) && presentSupport) graphicsFamily = i;
+    }
+    assert(graphicsFamily != familyCount);
+    
+    // a dedicated compute family if there is one, the graphics queue otherwise
+    computeFamily = graphicsFamily;
+    for (uint32_t i = 0; i < familyCount && ASYNC_COMPUTE && computeFamily == graphicsFamily; i++)
+    {
+        if((families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) computeFamily = i;
+    }
+    
     float queuePriority = 1.0f;
-    queueCreateInfo.pQueuePriorities = &queuePriority;
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    queueCreateInfos.push_back(queueCreateInfo);
+    std::set<uint32_t> uniqueFamilies = { graphicsFamily, computeFamily };
+    for (uint32_t family : uniqueFamilies)
+    {
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = family;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = &queuePriority;
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+    
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
     
     VkPhysicalDeviceFeatures deviceFeatures{};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // impostors wider than one pixel where supported
+    deviceFeatures.largePoints = supportedFeatures.largePoints;
+    
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timelineFeatures.timelineSemaphore = VK_TRUE;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &timelineFeatures;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
-    const std::vector<const char*> enabledExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    std::vector<const char*> enabledExtensions;
+    if(!settings.headless) enabledExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
     createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
     createInfo.ppEnabledExtensionNames = enabledExtensions.data();
     createInfo.enabledLayerCount = 0;
 
     assert(vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) == VK_SUCCESS);
 
-    vkGetDeviceQueue(device, 0, 0, &instancingQueue);
-    vkGetDeviceQueue(device, 0, 0, &computeQueue);
-    vkGetDeviceQueue(device, 0, 0, &presentQueue);
+    vkGetDeviceQueue(device, graphicsFamily, 0, &instancingQueue);
+    vkGetDeviceQueue(device, computeFamily, 0, &computeQueue);
+    vkGetDeviceQueue(device, graphicsFamily, 0, &presentQueue);
+}
+
+
+
+// render targets standing in for the swapchain images, one per frame in flight so frames do not share one
+void App::InitOffscreenImages()
+{
+    swapChainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    swapChainExtent = { WINDOW_WIDTH, WINDOW_HEIGHT };
+    swapChainImages.resize(framesInFlight);
+    offscreenImagesMemory.resize(framesInFlight);
+    
+    for (uint32_t i = 0; i < framesInFlight; i++)
+    {
+        Util::CreateImage(device, physicalDevice, swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], offscreenImagesMemory[i]);
+    }
 }
 
 
@@ -243,7 +836,7 @@ void App::InitRenderPass()
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = settings.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentDescription depthAttachment{};
     depthAttachment.format = VK_FORMAT_D32_SFLOAT;
@@ -322,52 +915,153 @@ void App::InitCommandPool()
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    poolInfo.queueFamilyIndex = 0;
+    poolInfo.queueFamilyIndex = graphicsFamily;
 
     assert(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) == VK_SUCCESS);
+    
+    poolInfo.queueFamilyIndex = computeFamily;
+    assert(vkCreateCommandPool(device, &poolInfo, nullptr, &computeCommandPool) == VK_SUCCESS);
 }
 
 
-void App::InitSharingBuffers()
+void App::InitStateBuffers()
+{
+    CreateParticleBuffers(N);
+    SpawnParticles(0, N);
+}
+
+
+// state buffers and color buffer for capacity particles, contents undefined
+void App::CreateParticleBuffers(uint32_t capacity)
+{
+    particleCapacity = capacity;
+    VkDeviceSize bufferSize = ParticleLayout::StateSize(capacity);
+    VkDeviceSize colorBufferSize = ParticleLayout::StreamSize(capacity);
+    
+    stateBuffers.resize(framesInFlight);
+    stateBuffersMemory.resize(framesInFlight);
+
+    for (size_t i = 0; i < framesInFlight; i++)
+    {
+        Util::CreateBuffer(device, physicalDevice, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stateBuffers[i], stateBuffersMemory[i]);
+    }
+    
+    Util::CreateBuffer(device, physicalDevice, colorBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorBuffer, colorBufferMemory);
+}
+
+
+// one random fish from rndEngine, the same seed spawns the same fish wherever this is called
+void App::SpawnFish(glm::vec4& position, glm::vec4& velocity, glm::vec4& color)
 {
-    // Initialize particles
-    std::default_random_engine rndEngine((unsigned)time(nullptr));
     std::uniform_real_distribution<float> rndDist(0.0f, FIELD_SCALE);
     std::uniform_real_distribution<float> rNorm(-1.0f, 1.0f);
+    
+    position = glm::vec4(rndDist(rndEngine) * FIELD_SCALE, rndDist(rndEngine) * FIELD_SCALE,  rndDist(rndEngine) * FIELD_SCALE, 1.0f);
+    velocity = glm::vec4(glm::vec3(rNorm(rndEngine), rNorm(rndEngine),  rNorm(rndEngine)) * 0.003f, 0.0f);
+    color = glm::vec4(rndDist(rndEngine), rndDist(rndEngine),  rndDist(rndEngine), 1.0f);
+}
 
-    std::vector<InstanceParameters> particles(N);
-    for (auto& particle : particles)
+
+// random fish in [first, first + count), written to every state buffer
+void App::SpawnParticles(uint32_t first, uint32_t count)
+{
+    // packed streams, see ParticleLayout
+    std::vector<glm::vec4> state(count * ParticleLayout::STREAM_COUNT);
+    glm::vec4* positions = state.data() + count * ParticleLayout::POSITION;
+    glm::vec4* velocities = state.data() + count * ParticleLayout::VELOCITY;
+    glm::vec4* orientations = state.data() + count * ParticleLayout::ORIENTATION;
+    std::vector<glm::vec4> colors(count);
+    for (uint32_t i = 0; i < count; i++)
     {
-        particle.pos = glm::vec3(rndDist(rndEngine) * FIELD_SCALE, rndDist(rndEngine) * FIELD_SCALE,  rndDist(rndEngine) * FIELD_SCALE);
-        particle.vel = glm::vec3(rNorm(rndEngine), rNorm(rndEngine),  rNorm(rndEngine)) * 0.003f;
-        particle.rgb = glm::vec3(rndDist(rndEngine), rndDist(rndEngine),  rndDist(rndEngine));
+        SpawnFish(positions[i], velocities[i], colors[i]);
+        orientations[i] = ParticleLayout::Orientation(glm::vec3(velocities[i]));
     }
+    hostColors.resize(first + count);
+    std::copy(colors.begin(), colors.end(), hostColors.begin() + first);
 
-    VkDeviceSize bufferSize = sizeof(InstanceParameters) * N;
+    VkDeviceSize bufferSize = ParticleLayout::StateSize(count);
+    VkDeviceSize colorBufferSize = ParticleLayout::StreamSize(count);
 
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
-    Util::CreateBuffer(device, physicalDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    Util::CreateBuffer(device, physicalDevice, bufferSize + colorBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
     void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, particles.data(), (size_t)bufferSize);
+    vkMapMemory(device, stagingBufferMemory, 0, bufferSize + colorBufferSize, 0, &data);
+    memcpy(data, state.data(), (size_t)bufferSize);
+    memcpy((char*)data + bufferSize, colors.data(), (size_t)colorBufferSize);
     vkUnmapMemory(device, stagingBufferMemory);
 
-    sharingBuffers.resize(MAX_FRAMES);
-    sharingBuffersMemory.resize(MAX_FRAMES);
-
-    for (size_t i = 0; i < MAX_FRAMES; i++)
+    // the streams are capacity apart in the state buffers, uploads go through the compute queue that owns them
+    VkDeviceSize streamSize = ParticleLayout::StreamSize(count);
+    VkDeviceSize firstOffset = ParticleLayout::StreamSize(first);
+    for (size_t i = 0; i < framesInFlight; i++)
     {
-        Util::CreateBuffer(device, physicalDevice, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sharingBuffers[i], sharingBuffersMemory[i]);
-        Util::CopyBuffer(device, commandPool, instancingQueue, stagingBuffer, sharingBuffers[i], bufferSize);
+        for (uint32_t stream = 0; stream < ParticleLayout::STREAM_COUNT; stream++)
+        {
+            VkDeviceSize srcOffset = ParticleLayout::StreamOffset((ParticleLayout::Stream)stream, count);
+            VkDeviceSize dstOffset = ParticleLayout::StreamOffset((ParticleLayout::Stream)stream, particleCapacity) + firstOffset;
+            Util::CopyBuffer(device, computeCommandPool, computeQueue, stagingBuffer, stateBuffers[i], streamSize, srcOffset, dstOffset);
+        }
     }
+    
+    Util::CopyBuffer(device, computeCommandPool, computeQueue, stagingBuffer, colorBuffer, colorBufferSize, bufferSize, firstOffset);
 
     vkDestroyBuffer(device, stagingBuffer, nullptr);
     vkFreeMemory(device, stagingBufferMemory, nullptr);
 }
 
 
+// grows or shrinks the fish count live, existing fish keep their state
+void App::SetParticleCount(uint32_t count)
+{
+    count = std::clamp(count - count % 256, 256u, MAX_N);
+    requestedN = (int)count;
+    if(count == N) return;
+    
+    vkDeviceWaitIdle(device);
+    
+    if(count > particleCapacity)
+    {
+        // geometric growth so dragging the count up reallocates only a few times
+        std::vector<VkBuffer> oldStateBuffers = stateBuffers;
+        std::vector<VkDeviceMemory> oldStateBuffersMemory = stateBuffersMemory;
+        VkBuffer oldColorBuffer = colorBuffer;
+        VkDeviceMemory oldColorBufferMemory = colorBufferMemory;
+        uint32_t oldCapacity = particleCapacity;
+        
+        CreateParticleBuffers(std::min(std::max(count, oldCapacity * 2), MAX_N));
+        
+        for (size_t i = 0; i < framesInFlight; i++)
+        {
+            for (uint32_t stream = 0; stream < ParticleLayout::STREAM_COUNT; stream++)
+            {
+                VkDeviceSize srcOffset = ParticleLayout::StreamOffset((ParticleLayout::Stream)stream, oldCapacity);
+                VkDeviceSize dstOffset = ParticleLayout::StreamOffset((ParticleLayout::Stream)stream, particleCapacity);
+                Util::CopyBuffer(device, computeCommandPool, computeQueue, oldStateBuffers[i], stateBuffers[i], ParticleLayout::StreamSize(N), srcOffset, dstOffset);
+            }
+            vkDestroyBuffer(device, oldStateBuffers[i], nullptr);
+            vkFreeMemory(device, oldStateBuffersMemory[i], nullptr);
+        }
+        
+        Util::CopyBuffer(device, computeCommandPool, computeQueue, oldColorBuffer, colorBuffer, ParticleLayout::StreamSize(N));
+        vkDestroyBuffer(device, oldColorBuffer, nullptr);
+        vkFreeMemory(device, oldColorBufferMemory, nullptr);
+        
+        ShaderConstants constants = MakeShaderConstants();
+        computeShader.Resize(constants, stateBuffers, colorBuffer);
+        instancingRenderer.Resize(constants, computeShader.GetSharingBuffers());
+    }
+    
+    // removed fish are simply not simulated, added fish start at random
+    if(count > N) SpawnParticles(N, count - N);
+    N = count;
+    
+    // the next submission writes it to the gpu, no pipeline is rebuilt for it
+    computeShader.SetParticleCount(N);
+}
+
+
 void App::InitDepthImage()
 {
     Util::CreateImage(device, physicalDevice, swapChainExtent.width, swapChainExtent.height, VK_FORMAT_D32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
@@ -377,7 +1071,7 @@ void App::InitDepthImage()
 
 void App::InitCommandBuffers()
 {
-    commandBuffers.resize(MAX_FRAMES);
+    commandBuffers.resize(framesInFlight);
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -389,44 +1083,48 @@ void App::InitCommandBuffers()
 }
 
 
-void App::InitFenceAndSemaphores()
+// acquire and present only take binary semaphores, everything else is ordered by the timelines
+void App::InitSemaphores()
 {
-    computeSemaphores.resize(MAX_FRAMES);
-    instancingSemaphores.resize(MAX_FRAMES);
-    renderingSemaphores.resize(MAX_FRAMES);
-    instancingFences.resize(MAX_FRAMES);
-    computeFences.resize(MAX_FRAMES);
+    instancingSemaphores.resize(framesInFlight);
+    renderingSemaphores.resize(framesInFlight);
+    frameValues.assign(framesInFlight, 0);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for (int i = 0; i < MAX_FRAMES; i++)
+    for (uint32_t i = 0; i < framesInFlight; i++)
     {
         assert(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &instancingSemaphores[i]) == VK_SUCCESS);
         assert(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderingSemaphores[i]) == VK_SUCCESS);
-        assert(vkCreateFence(device, &fenceInfo, nullptr, &instancingFences[i]) == VK_SUCCESS);
-        assert(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &computeSemaphores[i]) == VK_SUCCESS);
-        assert(vkCreateFence(device, &fenceInfo, nullptr, &computeFences[i]) == VK_SUCCESS);
     }
+    
+    graphicsTimeline.Init(&device);
 }
 
 
 void App::RenderBegin()
 {
-    vkWaitForFences(device, 1, &instancingFences[frameIndex], VK_TRUE, UINT64_MAX);
-    assert(vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, instancingSemaphores[frameIndex], VK_NULL_HANDLE, &imageIndex) == VK_SUCCESS);
+    // the command buffer, uniforms and cull results of this frame are about to be overwritten
+    graphicsTimeline.Wait(frameValues[frameIndex]);
+    renderTimer.Collect(frameIndex);
+    if(settings.headless) imageIndex = frameIndex;
+    else assert(vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, instancingSemaphores[frameIndex], VK_NULL_HANDLE, &imageIndex) == VK_SUCCESS);
 
-    vkResetFences(device, 1, &instancingFences[frameIndex]);
     vkResetCommandBuffer(commandBuffers[frameIndex], 0);
     
     VkCommandBufferBeginInfo commandBufferBeginInfo{};
     commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     assert(vkBeginCommandBuffer(commandBuffers[frameIndex], &commandBufferBeginInfo) == VK_SUCCESS);
+    
+    renderTimer.Reset(commandBuffers[frameIndex], frameIndex);
+    renderTimer.Begin(commandBuffers[frameIndex], frameIndex, RENDER_FRAME);
+}
+
 
+// compute work of the frame (culling) is recorded between RenderBegin and RenderPassBegin
+void App::RenderPassBegin()
+{
     VkRenderPassBeginInfo renderPassBeginInfo{};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassBeginInfo.renderPass = renderPass;
@@ -461,36 +1159,57 @@ void App::RenderBegin()
 void App::RenderEnd()
 {
     vkCmdEndRenderPass(commandBuffers[frameIndex]);
+    renderTimer.End(commandBuffers[frameIndex], frameIndex, RENDER_FRAME);
     assert(vkEndCommandBuffer(commandBuffers[frameIndex]) == VK_SUCCESS);
     
     
-    VkSemaphore waitSemaphores[] = { computeSemaphores[frameIndex], instancingSemaphores[frameIndex] };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    // binary semaphores ignore their value, headless frames have no image to acquire or present
+    uint32_t semaphoreCount = settings.headless ? 1 : 2;
+    VkSemaphore waitSemaphores[] = { computeShader.GetTimeline().Get(), instancingSemaphores[frameIndex] };
+    uint64_t waitValues[] = { computeShader.GetTimeline().Pending(), 0 };
+    // the cull pass is dispatched indirectly from the particle count of the compute submission
+    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    
+    frameValues[frameIndex] = graphicsTimeline.Next();
+    VkSemaphore signalSemaphores[] = { graphicsTimeline.Get(), renderingSemaphores[frameIndex] };
+    uint64_t signalValues[] = { frameValues[frameIndex], 0 };
+    
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = semaphoreCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    timelineInfo.signalSemaphoreValueCount = semaphoreCount;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
     
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 2;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = semaphoreCount;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffers[frameIndex];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &renderingSemaphores[frameIndex];
-    assert(vkQueueSubmit(instancingQueue, 1, &submitInfo, instancingFences[frameIndex]) == VK_SUCCESS);
-
+    submitInfo.signalSemaphoreCount = semaphoreCount;
+    submitInfo.pSignalSemaphores = signalSemaphores;
+    assert(vkQueueSubmit(instancingQueue, 1, &submitInfo, VK_NULL_HANDLE) == VK_SUCCESS);
+    
 
-    VkPresentInfoKHR presentInfo{};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &renderingSemaphores[frameIndex];
 
-    VkSwapchainKHR swapChains[] = {swapChain};
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
-    assert(vkQueuePresentKHR(presentQueue, &presentInfo) == VK_SUCCESS);
+    if(!settings.headless)
+    {
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &renderingSemaphores[frameIndex];
+        
+        VkSwapchainKHR swapChains[] = {swapChain};
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = swapChains;
+        presentInfo.pImageIndices = &imageIndex;
+        assert(vkQueuePresentKHR(presentQueue, &presentInfo) == VK_SUCCESS);
+    }
     
-    frameIndex = (frameIndex + 1) % MAX_FRAMES;
+    frameIndex = (frameIndex + 1) % framesInFlight;
 }
 
 
@@ -499,7 +1218,116 @@ void App::RenderGUI()
     imGuiWrapper.BeginFrame("Vulkan Fish");
     {
         imGuiWrapper.ShowFPS();
-        ImGui::Text("%i Fishes", N);
+        ImGui::Text("%u frames in flight", framesInFlight);
+        
+        // gpu time per pass, the frame time graph is measured on the cpu
+        if(ImGui::CollapsingHeader("Profiler")) profiler.ShowGUI();
+        
+        // applied when the slider is released, growing beyond the capacity reallocates the particle buffers
+        ImGui::SliderInt("Fishes", &requestedN, 256, (int)MAX_N, "%d", ImGuiSliderFlags_Logarithmic);
+        if(ImGui::IsItemDeactivatedAfterEdit()) resizeRequested = true;
+        ImGui::Text("%u Fishes, capacity %u", N, particleCapacity);
+        
+        ImGui::Checkbox("Frustum Culling", &FRUSTUM_CULLING);
+        CullStatistics cullStats = instancingRenderer.GetCullStatistics();
+        ImGui::SameLine();
+        ImGui::Text("culled %u", cullStats.culled);
+        
+        // far fish are drawn as points
+        ImGui::Checkbox("Impostors", &IMPOSTORS);
+        if(IMPOSTORS) ImGui::SliderFloat("Impostor Distance", &IMPOSTOR_DISTANCE, 0.0f, 10.0f);
+        ImGui::SliderFloat("Draw Distance", &DRAW_DISTANCE, 0.0f, 10.0f);
+        ImGui::Text("near %u, far %u", cullStats.near, cullStats.far);
+        
+        const char* neighborSearchNames[] = { "Brute Force", "Brute Force (Tiled)", "Uniform Grid", "Verlet List" };
+        if(ImGui::BeginCombo("Neighbor Search", neighborSearchNames[(int)computeShader.GetNeighborSearch()]))
+        {
+            for (int mode = 0; mode < IM_ARRAYSIZE(neighborSearchNames); mode++)
+            {
+                if(!IsNeighborSearchSupported((NeighborSearch)mode)) continue;
+                if(ImGui::Selectable(neighborSearchNames[mode], mode == (int)computeShader.GetNeighborSearch())) computeShader.SetNeighborSearch((NeighborSearch)mode);
+            }
+            ImGui::EndCombo();
+        }
+        
+        if(computeShader.GetNeighborSearch() == NeighborSearch::VerletList)
+        {
+            float skin = computeShader.GetVerletSkin();
+            if(ImGui::SliderFloat("Verlet Skin", &skin, 0.0f, 0.05f)) computeShader.SetVerletSkin(skin);
+            
+            VerletStatistics stats = computeShader.GetVerletStatistics();
+            float rebuildRate = stats.stepCount > 0 ? 100.0f * stats.rebuildCount / stats.stepCount : 0.0f;
+            ImGui::Text("Rebuilds : %u / %u steps (%.1f%%)", stats.rebuildCount, stats.stepCount, rebuildRate);
+            ImGui::Text("Overflows : %u, max neighbors %u / %u", stats.overflowCount, stats.maxNeighborCount, computeShader.GetVerletCapacity());
+        }
+        
+        const char* lodModeNames[] = { "Off", "Camera Distance", "Neighbor Count" };
+        ImGui::Combo("Temporal LOD", &LOD_MODE, lodModeNames, IM_ARRAYSIZE(lodModeNames));
+        if(LOD_MODE == (int)TemporalLod::CameraDistance)
+        {
+            ImGui::SliderFloat("LOD Near Distance", &LOD_NEAR_DISTANCE, 0.0f, 3.0f);
+            ImGui::SliderFloat("LOD Distance Step", &LOD_DISTANCE_STEP, 0.01f, 1.0f);
+        }
+        if(LOD_MODE != (int)TemporalLod::Off) ImGui::SliderInt("LOD Max Interval", &LOD_MAX_INTERVAL, 1, 16);
+        
+        // frames between spatial reorderings of the particle streams
+        int reorderInterval = (int)computeShader.GetReorderInterval();
+        if(ImGui::SliderInt("Morton Reorder Interval (0 = off)", &reorderInterval, 0, 600)) computeShader.SetReorderInterval((uint32_t)reorderInterval);
+        
+        if(ImGui::BeginCombo("Workgroup Size", std::to_string(WORKGROUP_SIZE).c_str()))
+        {
+            for (uint32_t size = 32; size <= MaxWorkgroupSize(); size *= 2)
+            {
+                if(ImGui::Selectable(std::to_string(size).c_str(), size == WORKGROUP_SIZE)) WORKGROUP_SIZE = size;
+            }
+            ImGui::EndCombo();
+        }
+        
+        ImGui::SliderFloat("Simulation Rate (Hz)", &SIMULATION_RATE, 1.0f, 240.0f);
+        ImGui::SliderInt("Max Catch-up Steps", &MAX_CATCH_UP_STEPS, 1, 16);
+        if(settings.deterministic && simulationThread.IsRunning())
+        {
+            const SimulationSnapshot& snapshot = simulationThread.Newest();
+            ImGui::Text("seed %u, step %llu, state hash %016llx", settings.seed, (unsigned long long)snapshot.step, (unsigned long long)snapshot.hash);
+        }
+        else if(!stateHashes.empty())
+        {
+            ImGui::Text("seed %u, step %llu, state hash %016llx", settings.seed, (unsigned long long)stateHashes.back().first, (unsigned long long)stateHashes.back().second);
+        }
+        
+        if(simulationThread.IsRunning())
+        {
+            // the simulation thread steps at the rate on its own, the frames draw whatever step it published last
+            const SimulationSnapshot& snapshot = simulationThread.Newest();
+            ImGui::Text("cpu simulation: %u threads, %s, %.1f steps/s", snapshot.threadCount, snapshot.kernelName, snapshot.stepsPerSecond);
+            ImGui::Text("step %llu, %llu dropped, %llu duplicated", (unsigned long long)snapshot.step,
+                        (unsigned long long)simulationThread.GetDroppedCount(), (unsigned long long)simulationThread.GetDuplicatedCount());
+            ImGui::Checkbox("CPU Cell List", &CPU_CELL_LIST);
+            ImGui::SameLine();
+            ImGui::Text("build %.2f ms, query %.2f ms", snapshot.buildMs, snapshot.queryMs);
+        }
+        else
+        {
+            // runs before the next frame, rendering stops meanwhile
+            ImGui::InputInt("Fast Forward Steps", &FAST_FORWARD_STEPS);
+            ImGui::SliderInt("Steps per Submission", &STEPS_PER_SUBMISSION, 1, 256);
+            FAST_FORWARD_STEPS = std::max(FAST_FORWARD_STEPS, 0);
+            if(ImGui::Button("Fast Forward")) fastForwardRequested = true;
+            ImGui::SameLine();
+            ImGui::Text("%.0f steps/s", computeShader.GetAdvanceRate());
+            
+            // one step of compute.glsl on the cpu threads next to the gpu step
+            if(ImGui::Button("Check against CPU")) cpuCheckRequested = true;
+            ImGui::SameLine();
+            if(cpuCheckDeviation < 0.0f) ImGui::Text("%u threads, %s", cpuSimulator.GetThreadCount(), cpuSimulator.GetKernelName());
+            else ImGui::Text("max deviation %g, %.1f cpu steps/s", cpuCheckDeviation, cpuSimulator.GetAdvanceRate());
+            ImGui::Checkbox("CPU Cell List", &CPU_CELL_LIST);
+            if(cpuCheckDeviation >= 0.0f)
+            {
+                ImGui::SameLine();
+                ImGui::Text("build %.2f ms, query %.2f ms", cpuSimulator.GetBuildMilliseconds(), cpuSimulator.GetQueryMilliseconds());
+            }
+        }
         
         ImGui::SliderFloat("MAX_SPEED", (float*)&MAX_SPEED, 0.001f, 300.0f);
         ImGui::SliderFloat("ATTRACTION", (float*)&ATTRACTION, 0.001f, 300.0f);
@@ -515,13 +1343,67 @@ void App::RenderGUI()
         ImGui::SliderFloat("Camera FOV", (float*)&cameraFov, 0.0f, 180.0f);
     }
     imGuiWrapper.EndFrame(commandBuffers[frameIndex]);
-    
+}
+
+
+// parameters the GUI edits, applied before the next cull
+void App::ApplyRenderParameters()
+{
+    instancingRenderer.frustumCulling = FRUSTUM_CULLING;
+    instancingRenderer.impostors = IMPOSTORS;
+    instancingRenderer.impostorDistance = IMPOSTOR_DISTANCE;
+    instancingRenderer.drawDistance = DRAW_DISTANCE;
     instancingRenderer.cameraFov = cameraFov;
     instancingRenderer.cameraCenter = cameraCenter;
     instancingRenderer.cameraPos = cameraPos;
 }
 
 
+ParticleParameters App::MakeParticleParameters() const
+{
+    ParticleParameters p;
+    p.MAX_SPEED = MAX_SPEED / PARAM_MULTIPLY;
+    p.ATTRACTION = ATTRACTION / PARAM_MULTIPLY;
+    p.WALL_AVOIDANCE = WALL_AVOIDANCE / PARAM_MULTIPLY;
+    p.ATTRACTION_DISTANCE = ATTRACTION_DISTANCE;
+    p.ALIGNMENT_DISTANCE = ALIGNMENT_DISTANCE;
+    p.ALIGNMENT = ALIGNMENT / PARAM_MULTIPLY;
+    p.AVOIDANCE_DISTANCE = AVOIDANCE_DISTANCE;
+    p.AVOIDANCE = AVOIDANCE / PARAM_MULTIPLY;
+    p.VORTEX_FORCE = VORTEX_FORCE / PARAM_MULTIPLY;
+    return p;
+}
+
+
+LodParameters App::MakeLodParameters() const
+{
+    LodParameters lod;
+    lod.MODE = (TemporalLod)LOD_MODE;
+    lod.CAMERA_POS = glm::vec3(cameraPos);
+    lod.NEAR_DISTANCE = LOD_NEAR_DISTANCE;
+    lod.DISTANCE_STEP = LOD_DISTANCE_STEP;
+    lod.MAX_INTERVAL = (uint32_t)LOD_MAX_INTERVAL;
+    return lod;
+}
+
+
+ShaderConstants App::MakeShaderConstants() const
+{
+    // a rule with zero strength is compiled out
+    ShaderConstants constants;
+    constants.CAPACITY = particleCapacity;
+    constants.WORKGROUP_SIZE = WORKGROUP_SIZE;
+    constants.FIELD_SCALE = FIELD_SCALE;
+    constants.ENABLE_WALL_AVOIDANCE = WALL_AVOIDANCE != 0.0f;
+    constants.ENABLE_ATTRACTION = ATTRACTION != 0.0f;
+    constants.ENABLE_ALIGNMENT = ALIGNMENT != 0.0f;
+    constants.ENABLE_AVOIDANCE = AVOIDANCE != 0.0f;
+    constants.ENABLE_VORTEX = VORTEX_FORCE != 0.0f;
+    constants.DETERMINISTIC = settings.deterministic;
+    return constants;
+}
+
+
 void App::Finalize()
 {
     vkDestroyImageView(device, depthImageView, nullptr);
@@ -529,24 +1411,45 @@ void App::Finalize()
     vkFreeMemory(device, depthImageMemory, nullptr);
     for (auto framebuffer : swapChainFramebuffers) vkDestroyFramebuffer(device, framebuffer, nullptr);
     for (auto imageView : swapChainImageViews) vkDestroyImageView(device, imageView, nullptr);
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
+    if(settings.headless)
+    {
+        for (uint32_t i = 0; i < framesInFlight; i++)
+        {
+            vkDestroyImage(device, swapChainImages[i], nullptr);
+            vkFreeMemory(device, offscreenImagesMemory[i], nullptr);
+        }
+    }
+    else vkDestroySwapchainKHR(device, swapChain, nullptr);
 
     computeShader.Release();
     instancingRenderer.Release();
+    
+    for (size_t i = 0; i < framesInFlight; i++)
+    {
+        vkDestroyBuffer(device, stateBuffers[i], nullptr);
+        vkFreeMemory(device, stateBuffersMemory[i], nullptr);
+    }
+    vkDestroyBuffer(device, colorBuffer, nullptr);
+    vkFreeMemory(device, colorBufferMemory, nullptr);
     vkDestroyRenderPass(device, renderPass, nullptr);
 
 
-    for (int i = 0; i < MAX_FRAMES; i++)
+    for (uint32_t i = 0; i < framesInFlight; i++)
     {
         vkDestroySemaphore(device, renderingSemaphores[i], nullptr);
         vkDestroySemaphore(device, instancingSemaphores[i], nullptr);
-        vkDestroyFence(device, instancingFences[i], nullptr);
     }
+    graphicsTimeline.Release();
+    renderTimer.Release();
 
     vkDestroyCommandPool(device, commandPool, nullptr);
+    vkDestroyCommandPool(device, computeCommandPool, nullptr);
     vkDestroyDevice(device, nullptr);
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if(!settings.headless) vkDestroySurfaceKHR(instance, surface, nullptr);
     vkDestroyInstance(instance, nullptr);
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if(!settings.headless)
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 }
@@ -12,26 +12,73 @@
 #include <vector>
 #include <set>
 #include <random>
+#include <cmath>
+#include <ctime>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 
 #include "ComputeShader.hpp"
+#include "CpuBoidSimulator.hpp"
+#include "SimulationThread.hpp"
 #include "InstancingRenderer.hpp"
 #include "ImGuiWrapper.hpp"
+#include "Timeline.hpp"
+#include "GpuTimer.hpp"
+#include "Benchmark.hpp"
+#include "Profiler.hpp"
+
+
+// startup options, see main
+struct AppSettings
+{
+    // frames recorded ahead of the gpu and length of the state buffer ring, clamped to [2, 4]
+    uint32_t framesInFlight = 2;
+    // renders frameCount frames into offscreen images without a window, swapchain or gui, then returns,
+    // every frame advances one tick so runs do the same work on any device (software ones included)
+    bool headless = false;
+    uint32_t frameCount = 600;
+    // steps run without rendering before the first frame
+    uint32_t warmUpSteps = 0;
+    // the profiler history is written here when the main loop ends, nothing if empty
+    std::string profileOutput;
+    // headless sweep, frameCount frames are measured per case
+    bool runBenchmark = false;
+    // times the cpu neighbor kernels over the fish counts and distances of the sweep, without vulkan
+    bool runKernelBenchmark = false;
+    Benchmark benchmark;
+    // the flocking rules run on cpu threads (CpuBoidSimulator on a SimulationThread) and the gpu only renders, not with the benchmark
+    bool cpuSimulation = false;
+    // fish spawned from seed instead of the clock and the rules summed in fixed point (ShaderConstants::DETERMINISTIC),
+    // the StateHash after every frame is shown and written to hashOutput if set, headless runs hash every step
+    bool deterministic = false;
+    uint32_t seed = 0;
+    std::string hashOutput;
+};
 
 
 class App
 {
 
 public:
-    App(){}
+    App(const AppSettings& settings = AppSettings()) : settings(settings), framesInFlight(std::clamp(settings.framesInFlight, MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT)) {}
     void Run();
     
 private:
-    // particle count (N)
+    // particle count (N), a multiple of 256 that can change at runtime, see SetParticleCount
     const uint32_t N_desired = 30000;
-    const uint32_t N = N_desired - N_desired % 256;
+    uint32_t N = N_desired - N_desired % 256;
+    const uint32_t MAX_N = 1 << 21;
+    // particles the buffers hold, grows geometrically and never shrinks
+    uint32_t particleCapacity = 0;
     
+    const AppSettings settings;
     const float FIELD_SCALE = 1.0f;
-    const int MAX_FRAMES = 2;
+    // frames recorded ahead of the gpu, also the length of the state buffer ring,
+    // more hide longer simulation steps at the cost of latency
+    static constexpr uint32_t MIN_FRAMES_IN_FLIGHT = 2;
+    static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+    const uint32_t framesInFlight;
     const uint32_t WINDOW_WIDTH = 1300;
     const uint32_t WINDOW_HEIGHT = 800;
 
@@ -41,12 +88,19 @@ private:
     VkPhysicalDevice physicalDevice;
     VkDevice device;
 
+    // graphics and present share a family, compute runs on a family without graphics when the device has one
+    // so the simulation of the next frame overlaps the rendering of this one, otherwise all three are the same queue
+    const bool ASYNC_COMPUTE = true;
+    uint32_t graphicsFamily = 0;
+    uint32_t computeFamily = 0;
     VkQueue instancingQueue;
     VkQueue computeQueue;
     VkQueue presentQueue;
 
+    // headless, swapChainImages are offscreen images, one per frame in flight, and there is no window, surface or swapchain
     VkSwapchainKHR swapChain;
     std::vector<VkImage> swapChainImages;
+    std::vector<VkDeviceMemory> offscreenImagesMemory;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
     std::vector<VkImageView> swapChainImageViews;
@@ -54,27 +108,62 @@ private:
 
     VkRenderPass renderPass;
     VkCommandPool commandPool;
+    // for the compute family, the state and color buffers are only ever used there
+    VkCommandPool computeCommandPool;
     VkImage depthImage;
     VkDeviceMemory depthImageMemory;
     VkImageView depthImageView;
     std::vector<VkCommandBuffer> commandBuffers;
 
-    std::vector<VkSemaphore> computeSemaphores;
+    // swapchain image acquired and frame rendered, per frame in flight
     std::vector<VkSemaphore> instancingSemaphores;
     std::vector<VkSemaphore> renderingSemaphores;
-    std::vector<VkFence> instancingFences;
-    std::vector<VkFence> computeFences;
+    // every graphics submission, frameValues holds the value of the last submission of each frame in flight,
+    // the compute queue has its own timeline (ComputeShader::GetTimeline)
+    Timeline graphicsTimeline;
+    std::vector<uint64_t> frameValues;
+    // gpu time of each graphics submission and the passes in it
+    enum RenderSection { RENDER_FRAME = 0, RENDER_CULL, RENDER_DRAW, RENDER_GUI, RENDER_SECTION_COUNT };
+    GpuTimer renderTimer;
+    Profiler profiler;
+    double profilerFrameTime = 0.0;
+    // cpu side of the frame last submitted in each slot, its profiler row is completed with the gpu times
+    // read back when the slot comes round again
+    struct ProfiledFrame
+    {
+        double frameMs = -1.0;
+        // times of the cpu simulation in place of the compute passes, negative with the gpu simulation
+        double simulationMs = -1.0;
+        double sharingMs = -1.0;
+    };
+    std::vector<ProfiledFrame> profiledFrames;
     
     uint32_t frameIndex = 0;
     uint32_t imageIndex = 0;
+    
+    // fixed simulation tick, rendering interpolates between the last two states
+    double lastFrameTime = 0.0;
+    double simulationTime = 0.0;
+    float simulationInterpolation = 0.0f;
 
     
-    // shareing buffer between compute shader and instancing shader
-    std::vector<VkBuffer> sharingBuffers;
-    std::vector<VkDeviceMemory> sharingBuffersMemory;
+    // ring of simulation states, one per frame in flight, see ParticleLayout, the renderer draws from copies (ComputeShader::GetSharingBuffers)
+    std::vector<VkBuffer> stateBuffers;
+    std::vector<VkDeviceMemory> stateBuffersMemory;
+    
+    // per particle color, constant so one buffer serves every frame
+    VkBuffer colorBuffer;
+    VkDeviceMemory colorBufferMemory;
+    
+    // spawns the initial fish and every fish added later
+    std::default_random_engine rndEngine{settings.deterministic ? settings.seed : (unsigned)time(nullptr)};
         
     
     // gui parameters
+    bool FRUSTUM_CULLING = true;
+    bool IMPOSTORS = true;
+    float IMPOSTOR_DISTANCE = 1.5f;
+    float DRAW_DISTANCE = 10.0f;
     float cameraFov = 45.0f;
     glm::vec4 cameraPos = glm::vec4(1.2f,  FIELD_SCALE/2.0f, FIELD_SCALE/2.0f, 0.0f);
     glm::vec4 cameraCenter = glm::vec4(FIELD_SCALE/2.0f,FIELD_SCALE/2.0f,FIELD_SCALE/2.0f, 0.0f);
@@ -88,15 +177,64 @@ private:
     float AVOIDANCE = 0.0002f * PARAM_MULTIPLY;
     float AVOIDANCE_DISTANCE = 0.015f;
     float VORTEX_FORCE = 0.0f * PARAM_MULTIPLY;
+    uint32_t WORKGROUP_SIZE = 256;
+    float SIMULATION_RATE = 60.0f;
+    // ticks one frame may run to catch up, the remaining time is dropped
+    int MAX_CATCH_UP_STEPS = 4;
+    // steps run without rendering on demand from the GUI, AppSettings::warmUpSteps before the first frame
+    int FAST_FORWARD_STEPS = 1000;
+    int STEPS_PER_SUBMISSION = 64;
+    // a kernel benchmark case repeats whole steps for at least this long
+    const double KERNEL_BENCHMARK_SECONDS = 0.5;
+    bool fastForwardRequested = false;
+    // temporal level of detail, see TemporalLod
+    int LOD_MODE = 0;
+    float LOD_NEAR_DISTANCE = 0.6f;
+    float LOD_DISTANCE_STEP = 0.2f;
+    int LOD_MAX_INTERVAL = 4;
+    // applied before the next frame once the slider is released
+    int requestedN = (int)N;
+    bool resizeRequested = false;
+    // one step on the gpu and on the cpu from the same state, largest position difference, negative before the first check
+    bool cpuCheckRequested = false;
+    float cpuCheckDeviation = -1.0f;
+    bool CPU_CELL_LIST = true;
     
     
     ComputeShader computeShader;
+    CpuBoidSimulator cpuSimulator;
+    // owns cpuSimulator while it runs
+    SimulationThread simulationThread;
+    // host copy of the color buffer, the cpu simulation uploads it with every frame
+    std::vector<glm::vec4> hostColors;
+    double cpuUploadMs = 0.0;
+    // deterministic mode, (step, StateHash) of the newest state after every frame that stepped, every cpu step once the simulation thread stopped
+    std::vector<std::pair<uint64_t, uint64_t>> stateHashes;
     InstancingRenderer instancingRenderer;
     ImGuiWrapper imGuiWrapper;
     
     
     void InitWindow();
     void MainLoop();
+    void RunBenchmark();
+    void RunKernelBenchmark();
+    void ApplySimulationParameters();
+    void ConfigureSimulator(BoidSimulator& simulator);
+    void CheckAgainstCpu();
+    void LoadCpuState();
+    void StoreCpuState();
+    void UploadCpuState();
+    SimulationSettings MakeSimulationSettings() const;
+    void StopSimulationThread();
+    void RecordStateHash(uint64_t step, uint64_t hash);
+    uint64_t HashGpuState();
+    bool WriteStateHashes(const std::string& path) const;
+    void Frame(uint32_t stepCount);
+    uint32_t SimulationSteps();
+    double Time() const;
+    uint32_t MaxWorkgroupSize() const;
+    bool IsWorkgroupSizeSupported(uint32_t size) const;
+    bool IsNeighborSearchSupported(NeighborSearch mode) const;
     
     void InitVulkan();
     void InitInstance();
@@ -104,18 +242,29 @@ private:
     void InitPhysicalDevice();
     void InitLogicalDevice();
     void InitSwapChain();
+    void InitOffscreenImages();
     void InitImageViews();
     void InitRenderPass();
     void InitFramebuffers();
     void InitCommandPool();
-    void InitSharingBuffers();
+    void InitStateBuffers();
+    void CreateParticleBuffers(uint32_t capacity);
+    void SpawnParticles(uint32_t first, uint32_t count);
+    void SpawnFish(glm::vec4& position, glm::vec4& velocity, glm::vec4& color);
+    void SetParticleCount(uint32_t count);
     void InitDepthImage();
     void InitCommandBuffers();
-    void InitFenceAndSemaphores();
+    void InitSemaphores();
     
     void RenderBegin();
+    void RenderPassBegin();
     void RenderEnd();
     void RenderGUI();
+    void ApplyRenderParameters();
+    
+    ParticleParameters MakeParticleParameters() const;
+    LodParameters MakeLodParameters() const;
+    ShaderConstants MakeShaderConstants() const;
     
     void Finalize();
 };
@@ -0,0 +1,248 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool Benchmark::ParseOption(const std::string& option, const std::string& value)
+{
+    if(option == "--fish") _fishCounts = ParseValues(value);
+    else if(option == "--workgroup-size") _workgroupSizes = ParseValues(value);
+    else if(option == "--attraction-distance") _attractionDistances = ParseValues(value);
+    else if(option == "--alignment-distance") _alignmentDistances = ParseValues(value);
+    else if(option == "--avoidance-distance") _avoidanceDistances = ParseValues(value);
+    else if(option == "--neighbor-search")
+    {
+        _neighborSearches.clear();
+        for (const std::string& name : Split(value, ','))
+        {
+            bool known = false;
+            for (NeighborSearch mode : { NeighborSearch::BruteForce, NeighborSearch::TiledBruteForce, NeighborSearch::UniformGrid, NeighborSearch::VerletList })
+            {
+                if(name != NeighborSearchName(mode)) continue;
+                _neighborSearches.push_back(mode);
+                known = true;
+            }
+            if(!known)
+            {
+                std::cerr << "unknown neighbor search '" << name << "', expected brute, tiled, grid or verlet\n";
+                _valid = false;
+            }
+        }
+    }
+    else if(option == "--warmup") _warmupFrames = (uint32_t)std::atoi(value.c_str());
+    else if(option == "--seed") _seed = (uint32_t)std::atoi(value.c_str());
+    else if(option == "--format") _format = value == "json" ? Format::JSON : Format::CSV;
+    else if(option == "--output") _output = value;
+    else return false;
+    
+    return true;
+}
+
+
+std::vector<BenchmarkCase> Benchmark::Cases(const BenchmarkCase& defaults) const
+{
+    auto orDefault = [](const std::vector<double>& values, double value) { return values.empty() ? std::vector<double>{ value } : values; };
+    std::vector<double> fishCounts = orDefault(_fishCounts, defaults.fishCount);
+    std::vector<double> workgroupSizes = orDefault(_workgroupSizes, defaults.workgroupSize);
+    std::vector<double> attractionDistances = orDefault(_attractionDistances, defaults.attractionDistance);
+    std::vector<double> alignmentDistances = orDefault(_alignmentDistances, defaults.alignmentDistance);
+    std::vector<double> avoidanceDistances = orDefault(_avoidanceDistances, defaults.avoidanceDistance);
+    std::vector<NeighborSearch> neighborSearches = _neighborSearches.empty() ? std::vector<NeighborSearch>{ defaults.neighborSearch } : _neighborSearches;
+    
+    // the fish count varies slowest so buffers grow as few times as possible
+    std::vector<BenchmarkCase> cases;
+    for (double fishCount : fishCounts)
+    for (NeighborSearch neighborSearch : neighborSearches)
+    for (double workgroupSize : workgroupSizes)
+    for (double attractionDistance : attractionDistances)
+    for (double alignmentDistance : alignmentDistances)
+    for (double avoidanceDistance : avoidanceDistances)
+    {
+        BenchmarkCase config;
+        config.fishCount = (uint32_t)fishCount;
+        config.workgroupSize = (uint32_t)workgroupSize;
+        config.attractionDistance = (float)attractionDistance;
+        config.alignmentDistance = (float)alignmentDistance;
+        config.avoidanceDistance = (float)avoidanceDistance;
+        config.neighborSearch = neighborSearch;
+        cases.push_back(config);
+    }
+    return cases;
+}
+
+
+BenchmarkResult Benchmark::Summarize(const BenchmarkCase& config, std::vector<double>& frameMs, double simulationMs, double renderMs)
+{
+    BenchmarkResult result{};
+    result.config = config;
+    result.frameCount = (uint32_t)frameMs.size();
+    if(frameMs.empty()) return result;
+    
+    std::sort(frameMs.begin(), frameMs.end());
+    // nearest rank
+    auto percentile = [&](double p) { return frameMs[std::min(frameMs.size() - 1, (size_t)std::ceil(p * frameMs.size()) - 1)]; };
+    result.frameMsP50 = percentile(0.5);
+    result.frameMsP90 = percentile(0.9);
+    result.frameMsP99 = percentile(0.99);
+    
+    double totalMs = 0.0;
+    for (double ms : frameMs) totalMs += ms;
+    result.simulationMs = simulationMs / frameMs.size();
+    result.renderMs = renderMs / frameMs.size();
+    result.fishPerSecond = totalMs > 0.0 ? config.fishCount * 1000.0 * frameMs.size() / totalMs : 0.0;
+    return result;
+}
+
+
+void Benchmark::Write(const std::vector<BenchmarkResult>& results) const
+{
+    std::ofstream file;
+    if(!_output.empty()) file.open(_output);
+    std::ostream& out = _output.empty() ? std::cout : file;
+    
+    if(_format == Format::JSON) WriteJSON(out, results);
+    else WriteCSV(out, results);
+}
+
+
+void Benchmark::Write(const std::vector<KernelBenchmarkResult>& results) const
+{
+    std::ofstream file;
+    if(!_output.empty()) file.open(_output);
+    std::ostream& out = _output.empty() ? std::cout : file;
+    
+    if(_format == Format::JSON) WriteJSON(out, results);
+    else WriteCSV(out, results);
+}
+
+
+void Benchmark::WriteCSV(std::ostream& out, const std::vector<BenchmarkResult>& results) const
+{
+    out << "fish,workgroup_size,attraction_distance,alignment_distance,avoidance_distance,neighbor_search,frames,sim_ms,render_ms,frame_ms_p50,frame_ms_p90,frame_ms_p99,fish_per_second\n";
+    for (const BenchmarkResult& r : results)
+    {
+        out << r.config.fishCount << ',' << r.config.workgroupSize << ','
+            << r.config.attractionDistance << ',' << r.config.alignmentDistance << ',' << r.config.avoidanceDistance << ','
+            << NeighborSearchName(r.config.neighborSearch) << ',' << r.frameCount << ','
+            << r.simulationMs << ',' << r.renderMs << ','
+            << r.frameMsP50 << ',' << r.frameMsP90 << ',' << r.frameMsP99 << ','
+            << r.fishPerSecond << '\n';
+    }
+}
+
+
+void Benchmark::WriteJSON(std::ostream& out, const std::vector<BenchmarkResult>& results) const
+{
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& r = results[i];
+        out << "  { \"fish\": " << r.config.fishCount
+            << ", \"workgroup_size\": " << r.config.workgroupSize
+            << ", \"attraction_distance\": " << r.config.attractionDistance
+            << ", \"alignment_distance\": " << r.config.alignmentDistance
+            << ", \"avoidance_distance\": " << r.config.avoidanceDistance
+            << ", \"neighbor_search\": \"" << NeighborSearchName(r.config.neighborSearch) << "\""
+            << ", \"frames\": " << r.frameCount
+            << ", \"sim_ms\": " << r.simulationMs
+            << ", \"render_ms\": " << r.renderMs
+            << ", \"frame_ms_p50\": " << r.frameMsP50
+            << ", \"frame_ms_p90\": " << r.frameMsP90
+            << ", \"frame_ms_p99\": " << r.frameMsP99
+            << ", \"fish_per_second\": " << r.fishPerSecond
+            << " }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+}
+
+
+void Benchmark::WriteCSV(std::ostream& out, const std::vector<KernelBenchmarkResult>& results) const
+{
+    out << "fish,attraction_distance,alignment_distance,avoidance_distance,isa,steps,interactions_per_second,speedup\n";
+    for (const KernelBenchmarkResult& r : results)
+    {
+        out << r.config.fishCount << ','
+            << r.config.attractionDistance << ',' << r.config.alignmentDistance << ',' << r.config.avoidanceDistance << ','
+            << NeighborKernel::Name(r.isa) << ',' << r.stepCount << ','
+            << r.interactionsPerSecond << ',' << r.speedup << '\n';
+    }
+}
+
+
+void Benchmark::WriteJSON(std::ostream& out, const std::vector<KernelBenchmarkResult>& results) const
+{
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const KernelBenchmarkResult& r = results[i];
+        out << "  { \"fish\": " << r.config.fishCount
+            << ", \"attraction_distance\": " << r.config.attractionDistance
+            << ", \"alignment_distance\": " << r.config.alignmentDistance
+            << ", \"avoidance_distance\": " << r.config.avoidanceDistance
+            << ", \"isa\": \"" << NeighborKernel::Name(r.isa) << "\""
+            << ", \"steps\": " << r.stepCount
+            << ", \"interactions_per_second\": " << r.interactionsPerSecond
+            << ", \"speedup\": " << r.speedup
+            << " }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+}
+
+
+// values and ranges separated by commas
+std::vector<double> Benchmark::ParseValues(const std::string& text)
+{
+    std::vector<double> values;
+    for (const std::string& item : Split(text, ','))
+    {
+        std::vector<std::string> range = Split(item, ':');
+        if(range.size() != 3)
+        {
+            values.push_back(std::atof(item.c_str()));
+            continue;
+        }
+        
+        double first = std::atof(range[0].c_str());
+        double last = std::atof(range[1].c_str());
+        bool multiply = !range[2].empty() && range[2][0] == 'x';
+        double step = std::atof(range[2].c_str() + (multiply ? 1 : 0));
+        // a step that never reaches last yields first only
+        bool progresses = multiply ? step > 1.0 && first > 0.0 : step > 0.0;
+        for (double value = first; value <= last * (1.0 + 1e-9); value = multiply ? value * step : value + step)
+        {
+            values.push_back(value);
+            if(!progresses) break;
+        }
+    }
+    return values;
+}
+
+
+std::vector<std::string> Benchmark::Split(const std::string& text, char separator)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator))
+    {
+        if(!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+
+const char* Benchmark::NeighborSearchName(NeighborSearch mode)
+{
+    switch (mode)
+    {
+        case NeighborSearch::BruteForce: return "brute";
+        case NeighborSearch::TiledBruteForce: return "tiled";
+        case NeighborSearch::UniformGrid: return "grid";
+        case NeighborSearch::VerletList: return "verlet";
+    }
+    return "";
+}
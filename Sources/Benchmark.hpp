@@ -0,0 +1,85 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "ComputeShader.hpp"
+#include "NeighborKernel.hpp"
+
+// one combination of the swept values
+struct BenchmarkCase
+{
+    uint32_t fishCount;
+    uint32_t workgroupSize;
+    float attractionDistance;
+    float alignmentDistance;
+    float avoidanceDistance;
+    NeighborSearch neighborSearch;
+};
+
+// measured over the frames of one case, every frame runs one simulation step
+struct BenchmarkResult
+{
+    BenchmarkCase config;
+    uint32_t frameCount;
+    double simulationMs;    // mean gpu time of the compute submission
+    double renderMs;        // mean gpu time of the graphics submission
+    double frameMsP50;      // cpu time between frames
+    double frameMsP90;
+    double frameMsP99;
+    double fishPerSecond;   // fish steps per second of wall time
+};
+
+// --kernel-benchmark times the cpu neighbor loop of one instruction set on one thread over every particle
+struct KernelBenchmarkResult
+{
+    BenchmarkCase config;
+    NeighborKernel::Isa isa;
+    uint32_t stepCount;
+    double interactionsPerSecond;   // particle pairs tested per second
+    double speedup;                 // over the scalar loop of the same case
+};
+
+// --benchmark runs every combination of the swept values headless, from the same seed, and writes one row per case,
+// a sweep is a comma separated list of values and ranges, first:last:step adds step, first:last:xF multiplies by F
+//   --fish 4096:65536:x2 --neighbor-search grid,verlet --format json --output results.json
+class Benchmark
+{
+public:
+    // returns false if option is not a benchmark option, a value it cannot use is reported and makes IsValid false
+    bool ParseOption(const std::string& option, const std::string& value);
+    bool IsValid() const { return _valid; }
+    // a value that is not swept keeps the one of defaults
+    std::vector<BenchmarkCase> Cases(const BenchmarkCase& defaults) const;
+    // frameMs is sorted in place
+    static BenchmarkResult Summarize(const BenchmarkCase& config, std::vector<double>& frameMs, double simulationMs, double renderMs);
+    // to the output file, stdout if there is none
+    void Write(const std::vector<BenchmarkResult>& results) const;
+    void Write(const std::vector<KernelBenchmarkResult>& results) const;
+    
+    uint32_t GetWarmupFrames() const { return _warmupFrames; }
+    uint32_t GetSeed() const { return _seed; }
+    
+private:
+    enum class Format { CSV, JSON };
+    Format _format = Format::CSV;
+    std::string _output;
+    uint32_t _warmupFrames = 120;
+    uint32_t _seed = 1;
+    bool _valid = true;
+    
+    std::vector<double> _fishCounts;
+    std::vector<double> _workgroupSizes;
+    std::vector<double> _attractionDistances;
+    std::vector<double> _alignmentDistances;
+    std::vector<double> _avoidanceDistances;
+    std::vector<NeighborSearch> _neighborSearches;
+    
+    static std::vector<double> ParseValues(const std::string& text);
+    static std::vector<std::string> Split(const std::string& text, char separator);
+    static const char* NeighborSearchName(NeighborSearch mode);
+    void WriteCSV(std::ostream& out, const std::vector<BenchmarkResult>& results) const;
+    void WriteJSON(std::ostream& out, const std::vector<BenchmarkResult>& results) const;
+    void WriteCSV(std::ostream& out, const std::vector<KernelBenchmarkResult>& results) const;
+    void WriteJSON(std::ostream& out, const std::vector<KernelBenchmarkResult>& results) const;
+};
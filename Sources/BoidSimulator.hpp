@@ -0,0 +1,59 @@
+#pragma once
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+#include "ShaderConstants.hpp"
+
+struct ParticleParameters
+{
+    float MAX_SPEED;
+    float ATTRACTION;
+    float WALL_AVOIDANCE;
+    float ATTRACTION_DISTANCE;
+    float ALIGNMENT_DISTANCE;
+    float ALIGNMENT;
+    float AVOIDANCE_DISTANCE;
+    float AVOIDANCE;
+    float VORTEX_FORCE;
+};
+
+// temporal level of detail, far or isolated particles run the flocking rules every few steps and drift in between
+enum class TemporalLod
+{
+    Off,
+    CameraDistance,     // interval grows by one every DISTANCE_STEP beyond NEAR_DISTANCE from the camera
+    NeighborCount,      // particles without neighbors at their last update wait MAX_INTERVAL steps
+};
+
+struct LodParameters
+{
+    TemporalLod MODE = TemporalLod::Off;
+    glm::vec3 CAMERA_POS = glm::vec3(0.0f);
+    float NEAR_DISTANCE = 0.6f;
+    float DISTANCE_STEP = 0.2f;
+    uint32_t MAX_INTERVAL = 4;
+};
+
+// what the app drives whichever backend runs the flocking rules, ComputeShader on the gpu or CpuBoidSimulator
+class BoidSimulator
+{
+public:
+    virtual ~BoidSimulator() {}
+    
+    virtual void SetParameters(ParticleParameters params) = 0;
+    virtual void SetLodParameters(const LodParameters& lod) = 0;
+    // rules switched off by the constants are skipped, see MakeShaderConstants
+    virtual void SetShaderConstants(const ShaderConstants& constants) = 0;
+    
+    virtual void SetParticleCount(uint32_t count) = 0;
+    virtual uint32_t GetParticleCount() const = 0;
+    // after the state was rewritten, the next step starts over (step counter, lod history, statistics)
+    virtual void ResetState() = 0;
+    
+    // runs stepCount ticks without rendering, blocks until they are done and returns the steps per second achieved
+    virtual double Advance(uint32_t stepCount) = 0;
+    virtual double GetAdvanceRate() const = 0;
+};
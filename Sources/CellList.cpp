@@ -0,0 +1,150 @@
+#include "CellList.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+void CellList::Build(const glm::vec4* positions, const glm::vec4* velocities, uint32_t count, const ParticleParameters& params, const ShaderConstants& constants, WorkStealingPool& pool)
+{
+    GridLayout layout = GridLayout::For(params, constants);
+    _cellSize = layout.cellSize;
+    _gridDim = layout.dim;
+    _cellCount = layout.CellCount();
+    
+    _keys.resize(count);
+    _indices.resize(count);
+    pool.ParallelFor(0, count, GRAIN, [&](uint32_t first, uint32_t last)
+    {
+        for (uint32_t i = first; i < last; i++)
+        {
+            _keys[i] = CellIndex(CellCoord(positions[i].x), CellCoord(positions[i].y), CellCoord(positions[i].z));
+            _indices[i] = i;
+        }
+    });
+    
+    Sort(count, pool);
+    FindCellStarts(count, pool);
+    
+    _streams.Resize(count);
+    pool.ParallelFor(0, count, GRAIN, [&](uint32_t first, uint32_t last)
+    {
+        _streams.Load(positions, velocities, _indices.data(), first, last);
+    });
+}
+
+
+void CellList::Gather(glm::vec3 pos, NeighborKernel::Function kernel, const NeighborRules& rules, Neighborhood& n) const
+{
+    uint32_t x = CellCoord(pos.x);
+    uint32_t y = CellCoord(pos.y);
+    uint32_t z = CellCoord(pos.z);
+    uint32_t maxCoord = _gridDim - 1;
+    
+    uint32_t firstX = x > 0 ? x - 1 : 0;
+    uint32_t lastX = std::min(x + 1, maxCoord);
+    for (uint32_t cz = z > 0 ? z - 1 : 0; cz <= std::min(z + 1, maxCoord); cz++)
+    {
+        for (uint32_t cy = y > 0 ? y - 1 : 0; cy <= std::min(y + 1, maxCoord); cy++)
+        {
+            kernel(_streams, _cellStart[CellIndex(firstX, cy, cz)], _cellStart[CellIndex(lastX, cy, cz) + 1], pos, rules, n);
+        }
+    }
+}
+
+
+// positions outside the field are clamped into the border cells like cellCoord in grid_common.glsl,
+// clamped as a float first so far away particles cannot overflow the conversion
+uint32_t CellList::CellCoord(float x) const
+{
+    float cell = std::floor(x / _cellSize);
+    return (uint32_t)std::min(std::max(cell, 0.0f), (float)(_gridDim - 1));
+}
+
+
+// one pass per RADIX_BITS of the largest key, each pass counts the digits per block, turns the counts into
+// the first slot of every digit and block (digit major, so blocks of the same digit stay in order) and scatters,
+// every pass is stable so the slots end up sorted by the whole key and by particle index within a cell
+void CellList::Sort(uint32_t count, WorkStealingPool& pool)
+{
+    uint32_t keyBits = 0;
+    while((1u << keyBits) < _cellCount) keyBits++;
+    uint32_t passCount = (keyBits + RADIX_BITS - 1) / RADIX_BITS;
+    
+    uint32_t blockCount = std::max(std::min(pool.GetThreadCount() * 4, count / GRAIN), 1u);
+    uint32_t blockSize = (count + blockCount - 1) / blockCount;
+    _histograms.resize(blockCount * RADIX);
+    _keysScratch.resize(count);
+    _indicesScratch.resize(count);
+    
+    for (uint32_t pass = 0; pass < passCount; pass++)
+    {
+        uint32_t shift = pass * RADIX_BITS;
+        
+        pool.ParallelFor(0, blockCount, 1, [&](uint32_t firstBlock, uint32_t lastBlock)
+        {
+            for (uint32_t block = firstBlock; block < lastBlock; block++)
+            {
+                uint32_t* histogram = &_histograms[block * RADIX];
+                std::fill(histogram, histogram + RADIX, 0);
+                for (uint32_t i = block * blockSize; i < std::min(count, (block + 1) * blockSize); i++)
+                {
+                    histogram[(_keys[i] >> shift) & (RADIX - 1)]++;
+                }
+            }
+        });
+        
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < RADIX; digit++)
+        {
+            for (uint32_t block = 0; block < blockCount; block++)
+            {
+                uint32_t& slot = _histograms[block * RADIX + digit];
+                uint32_t digitCount = slot;
+                slot = offset;
+                offset += digitCount;
+            }
+        }
+        
+        pool.ParallelFor(0, blockCount, 1, [&](uint32_t firstBlock, uint32_t lastBlock)
+        {
+            for (uint32_t block = firstBlock; block < lastBlock; block++)
+            {
+                uint32_t* next = &_histograms[block * RADIX];
+                for (uint32_t i = block * blockSize; i < std::min(count, (block + 1) * blockSize); i++)
+                {
+                    uint32_t slot = next[(_keys[i] >> shift) & (RADIX - 1)]++;
+                    _keysScratch[slot] = _keys[i];
+                    _indicesScratch[slot] = _indices[i];
+                }
+            }
+        });
+        
+        _keys.swap(_keysScratch);
+        _indices.swap(_indicesScratch);
+    }
+}
+
+
+// the first slot of a key starts its cell and every empty cell before it, so empty cells span no slots
+// and the cells of a row can be read as one range
+void CellList::FindCellStarts(uint32_t count, WorkStealingPool& pool)
+{
+    _cellStart.resize(_cellCount + 1);
+    
+    pool.ParallelFor(0, count, GRAIN, [&](uint32_t first, uint32_t last)
+    {
+        for (uint32_t k = first; k < last; k++)
+        {
+            uint32_t firstCell = k == 0 ? 0 : _keys[k - 1] + 1;
+            for (uint32_t cell = firstCell; cell <= _keys[k]; cell++)
+            {
+                _cellStart[cell] = k;
+            }
+        }
+    });
+    
+    for (uint32_t cell = count == 0 ? 0 : _keys[count - 1] + 1; cell <= _cellCount; cell++)
+    {
+        _cellStart[cell] = count;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "BoidSimulator.hpp"
+#include "GridLayout.hpp"
+#include "NeighborKernel.hpp"
+#include "WorkStealingPool.hpp"
+
+#include <vector>
+
+// cpu counterpart of the grid_* passes, rebuilt every step: particles are sorted by cell with a parallel
+// least significant digit radix sort of their cell keys, their positions and velocities copied into streams in that order,
+// and every cell keeps the offset of its first particle, so a query visits the 27 cells around a position only
+class CellList
+{
+public:
+    // the same cells as the grid_* passes, see GridLayout
+    void Build(const glm::vec4* positions, const glm::vec4* velocities, uint32_t count, const ParticleParameters& params, const ShaderConstants& constants, WorkStealingPool& pool);
+    
+    // adds the particles of the cells around pos to n, one kernel call per row of three cells since a row is contiguous in the streams
+    void Gather(glm::vec3 pos, NeighborKernel::Function kernel, const NeighborRules& rules, Neighborhood& n) const;
+    
+    // particle indices in cell order, iterating in this order keeps the queries of one worker on the same cells
+    const std::vector<uint32_t>& GetSortedIndices() const { return _indices; }
+    uint32_t GetGridDim() const { return _gridDim; }
+    float GetCellSize() const { return _cellSize; }
+    
+private:
+    static constexpr uint32_t RADIX_BITS = 8;
+    static constexpr uint32_t RADIX = 1 << RADIX_BITS;
+    // particles per task of the key, offset and stream loops, and at least per radix sort block
+    static constexpr uint32_t GRAIN = 4096;
+    
+    uint32_t CellCoord(float x) const;
+    uint32_t CellIndex(uint32_t x, uint32_t y, uint32_t z) const { return x + _gridDim * (y + _gridDim * z); }
+    
+    void Sort(uint32_t count, WorkStealingPool& pool);
+    void FindCellStarts(uint32_t count, WorkStealingPool& pool);
+    
+    uint32_t _gridDim = 1;
+    float _cellSize = 1.0f;
+    uint32_t _cellCount = 1;
+    
+    // cell key and particle index of every slot, sorted by key, and the scatter targets of a radix pass
+    std::vector<uint32_t> _keys;
+    std::vector<uint32_t> _indices;
+    std::vector<uint32_t> _keysScratch;
+    std::vector<uint32_t> _indicesScratch;
+    // RADIX counts per block of a pass, then the slot its next particle of that digit goes to
+    std::vector<uint32_t> _histograms;
+    // first slot of every cell, _cellCount + 1 entries so cell c spans [_cellStart[c], _cellStart[c + 1])
+    std::vector<uint32_t> _cellStart;
+    
+    NeighborStreams _streams;
+};
@@ -1,35 +1,105 @@
 #include "ComputeShader.hpp"
 #include "Util.hpp"
 
-void ComputeShader::Init(VkDevice* device, VkPhysicalDevice* physicalDevice, uint32_t particleNum, std::vector<VkBuffer> shaderStorageBuffers, VkCommandPool* commandPool)
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+
+void ComputeShader::Init(VkDevice* device, VkPhysicalDevice* physicalDevice, const ShaderConstants& constants, uint32_t frameCount, std::vector<VkBuffer> shaderStorageBuffers, VkBuffer colorBuffer, VkCommandPool* commandPool, VkQueue* queue, uint32_t computeFamily, uint32_t graphicsFamily)
 {
     _device = device;
     _physicalDevice = physicalDevice;
-    _N = particleNum;
+    _constants = constants;
+    _capacity = constants.CAPACITY;
+    _frameCount = frameCount;
     _shaderStorageBuffers = shaderStorageBuffers;
+    _stateBufferCount = static_cast<uint32_t>(shaderStorageBuffers.size());
+    _stateIndex = _stateBufferCount - 1;
+    _colorBuffer = colorBuffer;
     _commandPool = commandPool;
+    _queue = queue;
+    _computeFamily = computeFamily;
+    _graphicsFamily = graphicsFamily;
     
     CreateComputeDescriptorSetLayout();
     CreateComputePipeline();
     CreateComputeUniformBuffers();
+    CreateGridBuffers();
+    CreateReorderBuffers();
+    CreateVerletBuffers();
+    CreateLodBuffers();
+    CreateSharingBuffers();
+    CreateParticleCountBuffer();
     CreateComputeDescriptorPool();
     CreateComputeDescriptorSets();
     CreateComputeCommandBuffers();
+    
+    _timeline.Init(_device);
+    _frameValues.assign(_frameCount, 0);
+    _timer.Init(_device, _physicalDevice, _computeFamily, _frameCount, TIMED_PASS_COUNT);
 }
 
 
 
-void ComputeShader::Execute(uint32_t frame, VkSemaphore* computeFinishedSemaphore, VkFence* computeInFlightFence, VkQueue queue)
+void ComputeShader::Execute(uint32_t frame, uint32_t stepCount, VkSemaphore graphicsTimeline, uint64_t graphicsValue)
 {
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    // the cpu only waits for what it overwrites, the command buffer, uniforms and statistics of this frame,
+    // the sharing buffer is waited for on the gpu
+    _timeline.Wait(_frameValues[frame]);
+    _timer.Collect(frame);
+
+    // the last submission of this frame is done, so are its statistics and timings
+    if(_neighborSearch == NeighborSearch::VerletList)
+    {
+        memcpy(&_verletStatistics, _verletStatisticsBuffersMapped[frame], sizeof(VerletStatistics));
+    }
+    
+    WriteParameters(frame);
+
+    // submitted even without a step due, the renderer waits on the timeline value every frame
+    RecordSteps(frame, stepCount, true);
+    Submit(frame, graphicsTimeline, graphicsValue);
+}
 
-    // Compute submission
-    vkWaitForFences(*_device, 1, computeInFlightFence, VK_TRUE, UINT64_MAX);
 
+double ComputeShader::Advance(uint32_t stepCount)
+{
+    uint32_t batchSize = _advanceBatchSize;
+    
+    auto begin = std::chrono::steady_clock::now();
     
+    // batches alternate between the frame command buffers, so one is recorded while the other runs,
+    // a frame still in flight holds its command buffer until its value is reached
+    uint32_t batch = 0;
+    for (uint32_t done = 0; done < stepCount; done += batchSize, batch++)
+    {
+        uint32_t frame = batch % _frameCount;
+        
+        _timeline.Wait(_frameValues[frame]);
+        
+        WriteParameters(frame);
+        RecordSteps(frame, std::min(batchSize, stepCount - done), false);
+        Submit(frame, VK_NULL_HANDLE, 0);
+    }
+    
+    _timeline.Wait(_timeline.Pending());
+    
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    _advanceRate = elapsed.count() > 0.0 ? stepCount / elapsed.count() : 0.0;
+    
+    if(_neighborSearch == NeighborSearch::VerletList && batch > 0)
+    {
+        memcpy(&_verletStatistics, _verletStatisticsBuffersMapped[(batch - 1) % _frameCount], sizeof(VerletStatistics));
+    }
     
-    ParticleParameters ubo{};
+    return _advanceRate;
+}
+
+
+void ComputeShader::WriteParameters(uint32_t frame)
+{
+    ComputeUniforms ubo{};
     ubo.MAX_SPEED = _params.MAX_SPEED;
     ubo.ATTRACTION = _params.ATTRACTION;
     ubo.WALL_AVOIDANCE = _params.WALL_AVOIDANCE;
@@ -39,76 +109,586 @@ void ComputeShader::Execute(uint32_t frame, VkSemaphore* computeFinishedSemaphor
     ubo.AVOIDANCE_DISTANCE = _params.AVOIDANCE_DISTANCE;
     ubo.AVOIDANCE = _params.AVOIDANCE;
     ubo.VORTEX_FORCE = _params.VORTEX_FORCE;
+    ubo.LOD_CAMERA = glm::vec4(_lod.CAMERA_POS, 1.0f);
+    ubo.LOD_NEAR_DISTANCE = _lod.NEAR_DISTANCE;
+    ubo.LOD_DISTANCE_STEP = std::max(_lod.DISTANCE_STEP, 1e-4f);
+    ubo.LOD_MAX_INTERVAL = std::max(_lod.MAX_INTERVAL, 1u);
+    ubo.LOD_MODE = (uint32_t)_lod.MODE;
     memcpy(_computeUniformBuffersMapped[frame], &ubo, sizeof(ubo));
+}
+
+
+// stepCount ticks back to back in the command buffer of this frame, separated by global memory barriers
+// since the grid and verlet buffers carry data between steps as well as the state buffers,
+// followed by the copy into the sharing buffer of this frame when share is set
+void ComputeShader::RecordSteps(uint32_t frame, uint32_t stepCount, bool share)
+{
+    vkResetCommandBuffer(_computeCommandBuffers[frame], /*VkCommandBufferResetFlagBits*/ 0);
+    
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    assert(vkBeginCommandBuffer(_computeCommandBuffers[frame], &beginInfo) == VK_SUCCESS);
+
+    // counters accumulate on the gpu, they start from zero on the first submission
+    if(!_countersCleared)
+    {
+        vkCmdFillBuffer(_computeCommandBuffers[frame], _verletStateBuffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(_computeCommandBuffers[frame], _lodNeighborsBuffer, 0, VK_WHOLE_SIZE, 0);
+        _countersCleared = true;
+    }
+
+    // previous submissions on this queue wrote the buffer we read and the grid we rebuild, and dispatched from the particle count,
+    // the renderer only reads the sharing buffers so no graphics stage is involved
+    VkMemoryBarrier frameBarrier{};
+    frameBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    frameBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    frameBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(_computeCommandBuffers[frame], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &frameBarrier, 0, nullptr, 0, nullptr);
+    
+    _timer.Reset(_computeCommandBuffers[frame], frame);
+    _timer.Begin(_computeCommandBuffers[frame], frame, STEPS_PASS);
     
+    RecordParticleCount(_computeCommandBuffers[frame], frame);
+
+    for (uint32_t step = 0; step < stepCount; step++)
+    {
+        RecordStep(_computeCommandBuffers[frame], frame);
+    }
     
+    _timer.End(_computeCommandBuffers[frame], frame, STEPS_PASS);
     
+    if(share)
+    {
+        _timer.Begin(_computeCommandBuffers[frame], frame, SHARING_PASS);
+        RecordSharing(_computeCommandBuffers[frame], frame);
+        _timer.End(_computeCommandBuffers[frame], frame, SHARING_PASS);
+    }
+    
+    // deterministic mode hashes the state buffers on the host once the timeline value of this submission is reached
+    if(_constants.DETERMINISTIC)
+    {
+        VkMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(_computeCommandBuffers[frame], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+    }
 
-    vkResetFences(*_device, 1, computeInFlightFence);
+    assert(vkEndCommandBuffer(_computeCommandBuffers[frame]) == VK_SUCCESS);
+}
 
-    vkResetCommandBuffer(_computeCommandBuffers[frame], /*VkCommandBufferResetFlagBits*/ 0);
+
+// signals the next value of the timeline, if a waitSemaphore is given every transfer command of the submission waits for waitValue,
+// the sharing copy but also the fills of the step, RecordParticleCount and the morton copies, only the dispatches before
+// the first of them overlap the frame still drawing
+void ComputeShader::Submit(uint32_t frame, VkSemaphore waitSemaphore, uint64_t waitValue)
+{
+    uint64_t signalValue = _timeline.Next();
+    VkSemaphore signalSemaphore = _timeline.Get();
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = waitSemaphore != VK_NULL_HANDLE ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+    
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = timelineInfo.waitSemaphoreValueCount;
+    submitInfo.pWaitSemaphores = &waitSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &_computeCommandBuffers[frame];
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &signalSemaphore;
+    
+    assert(vkQueueSubmit(*_queue, 1, &submitInfo, VK_NULL_HANDLE) == VK_SUCCESS);
+    _frameValues[frame] = signalValue;
+}
+
+
+// copies the newest two states, the colors and the particle count into the sharing buffer of this frame,
+// the next submission then runs while this frame is drawn without touching anything it reads
+void ComputeShader::RecordSharing(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    // the last pass wrote what is copied
+    ComputeBarrier(commandBuffer);
     
+    VkBuffer sharingBuffer = _sharingBuffers[frame];
+    VkBuffer newestBuffer = _shaderStorageBuffers[_stateIndex];
+    VkBuffer previousBuffer = _shaderStorageBuffers[(_stateIndex + _stateBufferCount - 1) % _stateBufferCount];
     
+    // the live count is only known on the gpu so whole streams are copied
+    VkDeviceSize streamSize = ParticleLayout::StreamSize(_capacity);
+    VkDeviceSize positionOffset = ParticleLayout::StreamOffset(ParticleLayout::POSITION, _capacity);
+    VkDeviceSize orientationOffset = ParticleLayout::StreamOffset(ParticleLayout::ORIENTATION, _capacity);
     
+    VkBufferCopy newestCopies[] =
+    {
+        { positionOffset, streamSize * ParticleLayout::NEWEST_POSITION, streamSize },
+        { orientationOffset, streamSize * ParticleLayout::NEWEST_ORIENTATION, streamSize },
+    };
+    vkCmdCopyBuffer(commandBuffer, newestBuffer, sharingBuffer, 2, newestCopies);
     
+    VkBufferCopy previousCopies[] =
+    {
+        { positionOffset, streamSize * ParticleLayout::PREVIOUS_POSITION, streamSize },
+        { orientationOffset, streamSize * ParticleLayout::PREVIOUS_ORIENTATION, streamSize },
+    };
+    vkCmdCopyBuffer(commandBuffer, previousBuffer, sharingBuffer, 2, previousCopies);
     
+    VkBufferCopy colorCopy = { 0, streamSize * ParticleLayout::COLOR, streamSize };
+    vkCmdCopyBuffer(commandBuffer, _colorBuffer, sharingBuffer, 1, &colorCopy);
     
-    //RecordComputeCommandBuffer();
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    VkBufferCopy countCopy = { 0, ParticleLayout::SharedCountOffset(_capacity), sizeof(ParticleLayout::ParticleCount) };
+    vkCmdCopyBuffer(commandBuffer, _particleCountBuffer, sharingBuffer, 1, &countCopy);
+    
+    // on one queue family the semaphore the renderer waits on makes the copies visible,
+    // otherwise ownership is released here and acquired by InstancingRenderer::Cull, it is never released back
+    // since the next copy overwrites the whole buffer
+    if(_computeFamily == _graphicsFamily) return;
+    
+    VkBufferMemoryBarrier release{};
+    release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    release.dstAccessMask = 0;
+    release.srcQueueFamilyIndex = _computeFamily;
+    release.dstQueueFamilyIndex = _graphicsFamily;
+    release.buffer = sharingBuffer;
+    release.offset = 0;
+    release.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+}
 
-    assert(vkBeginCommandBuffer(_computeCommandBuffers[frame], &beginInfo) == VK_SUCCESS);
 
-    vkCmdBindPipeline(_computeCommandBuffers[frame], VK_PIPELINE_BIND_POINT_COMPUTE, _computePipeline);
+// one simulation tick from the newest state buffer into the other one
+void ComputeShader::RecordStep(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    if(_reorderInterval > 0 && _stepCount % _reorderInterval == 0)
+    {
+        RecordMortonReorder(commandBuffer, frame);
+    }
+    _stepCount++;
+
+    if(_neighborSearch == NeighborSearch::UniformGrid)
+    {
+        RecordGridPasses(commandBuffer, frame);
+    }
+    else if(_neighborSearch == NeighborSearch::VerletList)
+    {
+        RecordVerletPasses(commandBuffer, frame);
+    }
+    else
+    {
+        VkPipeline pipeline = _neighborSearch == NeighborSearch::TiledBruteForce ? _tiledComputePipeline : _computePipeline;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+        VkDescriptorSet descriptorSet = StepDescriptorSet(frame);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _computePipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+        
+        // only the step counter is read by the brute force kernels
+        GridParameters grid = CalculateGridParameters();
+        vkCmdPushConstants(commandBuffer, _computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GridParameters), &grid);
 
-    vkCmdBindDescriptorSets(_computeCommandBuffers[frame], VK_PIPELINE_BIND_POINT_COMPUTE, _computePipelineLayout, 0, 1, &_computeDescriptorSets[frame], 0, nullptr);
+        DispatchParticles(commandBuffer);
+    }
+    
+    // the next step reads what this one wrote
+    ComputeBarrier(commandBuffer);
+    _stateIndex = (_stateIndex + 1) % _stateBufferCount;
+}
 
-    vkCmdDispatch(_computeCommandBuffers[frame], _N / 256, 1, 1);
 
-    assert(vkEndCommandBuffer(_computeCommandBuffers[frame]) == VK_SUCCESS);
+// the count requested by the host if any, then the indirect arguments of every pass
+void ComputeShader::RecordParticleCount(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    if(_particleCountPending)
+    {
+        vkCmdUpdateBuffer(commandBuffer, _particleCountBuffer, offsetof(ParticleLayout::ParticleCount, N), sizeof(uint32_t), &_N);
+        ComputeBarrier(commandBuffer);
+        _particleCountPending = false;
+    }
     
+    VkDescriptorSet descriptorSet = StepDescriptorSet(frame);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _computePipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _particleCountPipeline);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    
+    VkMemoryBarrier countBarrier{};
+    countBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    countBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    countBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &countBarrier, 0, nullptr, 0, nullptr);
+}
+
+
+// one group per WORKGROUP_SIZE live particles
+void ComputeShader::DispatchParticles(VkCommandBuffer commandBuffer)
+{
+    vkCmdDispatchIndirect(commandBuffer, _particleCountBuffer, offsetof(ParticleLayout::ParticleCount, particleDispatch));
+}
+
+
+// set of this frame that reads the newest state buffer and writes the other one
+VkDescriptorSet ComputeShader::StepDescriptorSet(uint32_t frame) const
+{
+    uint32_t target = (_stateIndex + 1) % _stateBufferCount;
+    return _computeDescriptorSets[frame * _stateBufferCount + target];
+}
+
+
+void ComputeShader::RecordGridPasses(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    GridParameters grid = CalculateGridParameters();
     
+    VkDescriptorSet descriptorSet = StepDescriptorSet(frame);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _computePipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
     
+    RecordGridSort(commandBuffer, grid, false);
     
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &_computeCommandBuffers[frame];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = computeFinishedSemaphore;
+    // 4. flocking rules over the 27 neighbor cells
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gridNeighborPipeline);
+    vkCmdPushConstants(commandBuffer, _computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GridParameters), &grid);
+    DispatchParticles(commandBuffer);
+}
+
+
+// passes 1-3 of the uniform grid, the group counts come from the verlet dispatch buffer when indirect
+// and from the particle count otherwise
+void ComputeShader::RecordGridSort(VkCommandBuffer commandBuffer, const GridParameters& gridParameters, bool indirect)
+{
+    GridParameters grid = gridParameters;
+    uint32_t cellGroups = (grid.CELL_COUNT + 255) / 256;
+    
+    auto dispatch = [&](uint32_t groupCount, DispatchSlot slot)
+    {
+        if(indirect) vkCmdDispatchIndirect(commandBuffer, _verletDispatchBuffer, sizeof(VkDispatchIndirectCommand) * slot);
+        else if(slot == PARTICLE_GROUPS) DispatchParticles(commandBuffer);
+        else vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+    };
+    
+    vkCmdFillBuffer(commandBuffer, _cellCountBuffer, 0, sizeof(uint32_t) * grid.CELL_COUNT, 0);
+    vkCmdFillBuffer(commandBuffer, _cellFillBuffer, 0, sizeof(uint32_t) * grid.CELL_COUNT, 0);
+    
+    VkMemoryBarrier clearBarrier{};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+    
+    // 1. cell of every particle + particles per cell
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gridAssignPipeline);
+    vkCmdPushConstants(commandBuffer, _computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GridParameters), &grid);
+    dispatch(0, PARTICLE_GROUPS);
+    ComputeBarrier(commandBuffer);
+    
+    // 2. prefix sum of the cell counts
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gridScanPipeline);
+    for (uint32_t stage = 0; stage < 3; stage++)
+    {
+        grid.STAGE = stage;
+        vkCmdPushConstants(commandBuffer, _computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GridParameters), &grid);
+        if(stage == 1) dispatch(1, SINGLE_GROUP);
+        else dispatch(cellGroups, CELL_GROUPS);
+        ComputeBarrier(commandBuffer);
+    }
+    grid.STAGE = 0;
+    
+    // 3. counting sort of particle indices by cell
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _gridScatterPipeline);
+    vkCmdPushConstants(commandBuffer, _computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GridParameters), &grid);
+    dispatch(0, PARTICLE_GROUPS);
+    ComputeBarrier(commandBuffer);
+}
+
 
-    assert(vkQueueSubmit(queue, 1, &submitInfo, *computeInFlightFence) == VK_SUCCESS);
+void ComputeShader::RecordVerletPasses(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    GridParameters grid = CalculateGridParameters(_verletSkin);
+    grid.LIST_RADIUS = grid.CELL_SIZE;
+    grid.HALF_SKIN = _verletSkin * 0.5f;
+    grid.LIST_CAPACITY = VERLET_CAPACITY;
+    
+    // lists built with another radius miss or waste neighbors
+    if(grid.LIST_RADIUS != _verletListRadius) _verletRebuildPending = true;
+    _verletListRadius = grid.LIST_RADIUS;
+    grid.FORCE_REBUILD = _verletRebuildPending ? 1 : 0;
+    _verletRebuildPending = false;
+    
+    VkDescriptorSet descriptorSet = StepDescriptorSet(frame);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _computePipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, _computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GridParameters), &grid);
+    
+    // 1. largest displacement since the last rebuild
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _verletDisplacementPipeline);
+    DispatchParticles(commandBuffer);
+    ComputeBarrier(commandBuffer);
+    
+    // 2. rebuild decision, written as the group counts of the rebuild passes
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _verletDecidePipeline);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    
+    VkMemoryBarrier decideBarrier{};
+    decideBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    decideBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    decideBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &decideBarrier, 0, nullptr, 0, nullptr);
+    
+    // 3. rebuild through the uniform grid, every pass is dispatched with zero groups when the lists are still valid
+    RecordGridSort(commandBuffer, grid, true);
+    
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _verletBuildPipeline);
+    vkCmdPushConstants(commandBuffer, _computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GridParameters), &grid);
+    vkCmdDispatchIndirect(commandBuffer, _verletDispatchBuffer, sizeof(VkDispatchIndirectCommand) * PARTICLE_GROUPS);
+    ComputeBarrier(commandBuffer);
+    
+    // 4. flocking rules over the cached lists
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _verletNeighborPipeline);
+    DispatchParticles(commandBuffer);
+    
+    // statistics of this step, read once the compute timeline reaches the value of this frame
+    ComputeBarrier(commandBuffer);
+    VkBufferCopy statisticsCopy{};
+    statisticsCopy.size = sizeof(VerletStatistics);
+    vkCmdCopyBuffer(commandBuffer, _verletStateBuffer, _verletStatisticsBuffers[frame], 1, &statisticsCopy);
+    
+    VkMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+}
+
+
+void ComputeShader::RecordMortonReorder(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    uint32_t target = (_stateIndex + 1) % _stateBufferCount;
+    SortParameters sort{};
+    
+    VkDescriptorSet descriptorSet = StepDescriptorSet(frame);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _computePipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    
+    // 1. morton code of every position of the newest state
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _mortonCodePipeline);
+    vkCmdPushConstants(commandBuffer, _computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SortParameters), &sort);
+    DispatchParticles(commandBuffer);
+    ComputeBarrier(commandBuffer);
+    
+    // 2. LSD radix sort, keys ping-pong between the two halves and an even pass count leaves them in the first one
+    uint32_t passCount = (MORTON_BITS + RADIX_BITS - 1) / RADIX_BITS;
+    assert(passCount % 2 == 0);
+    
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _radixSortPipeline);
+    for (uint32_t pass = 0; pass < passCount; pass++)
+    {
+        sort.SHIFT = pass * RADIX_BITS;
+        sort.IN_OFFSET = (pass % 2) * _capacity;
+        sort.OUT_OFFSET = ((pass + 1) % 2) * _capacity;
+        
+        for (uint32_t stage = 0; stage < 3; stage++)
+        {
+            sort.STAGE = stage;
+            vkCmdPushConstants(commandBuffer, _computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SortParameters), &sort);
+            if(stage == 1) vkCmdDispatch(commandBuffer, 1, 1, 1);
+            else vkCmdDispatchIndirect(commandBuffer, _particleCountBuffer, offsetof(ParticleLayout::ParticleCount, sortDispatch));
+            ComputeBarrier(commandBuffer);
+        }
+    }
+    
+    // 3. gather the newest state into morton order
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _mortonReorderPipeline);
+    DispatchParticles(commandBuffer);
+    ComputeBarrier(commandBuffer);
+    
+    // 4. the sorted state becomes the newest state the step reads from, colors follow the same permutation,
+    // the live count is only known on the gpu so the whole capacity is copied
+    VkBufferCopy stateCopy{};
+    stateCopy.size = ParticleLayout::StateSize(_capacity);
+    vkCmdCopyBuffer(commandBuffer, _shaderStorageBuffers[target], _shaderStorageBuffers[_stateIndex], 1, &stateCopy);
+    
+    VkBufferCopy colorCopy{};
+    colorCopy.size = ParticleLayout::StreamSize(_capacity);
+    vkCmdCopyBuffer(commandBuffer, _colorScratchBuffer, _colorBuffer, 1, &colorCopy);
+    
+    VkMemoryBarrier copyBarrier{};
+    copyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    copyBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    copyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+    
+    // particle indices changed, every cached list is stale
+    _verletRebuildPending = true;
+}
+
+
+GridParameters ComputeShader::CalculateGridParameters(float padding) const
+{
+    GridLayout layout = GridLayout::For(_params, _constants, padding);
+    
+    GridParameters grid{};
+    grid.CELL_SIZE = layout.cellSize;
+    grid.GRID_DIM = layout.dim;
+    grid.CELL_COUNT = layout.CellCount();
+    grid.STAGE = 0;
+    grid.STEP = static_cast<uint32_t>(_stepCount);
+    return grid;
+}
+
+
+void ComputeShader::ComputeBarrier(VkCommandBuffer commandBuffer)
+{
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 }
 
 
 void ComputeShader::Release()
 {
+    _timeline.Release();
+    _timer.Release();
+    
+    DestroyComputePipelines();
+    vkDestroyPipelineLayout(*_device, _computePipelineLayout, nullptr);
+    
+    vkDestroyDescriptorPool(*_device, _computeDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(*_device, _computeDescriptorSetLayout, nullptr);
+    
+    for (size_t i = 0; i < _frameCount; i++)
+    {
+        vkDestroyBuffer(*_device, _computeUniformBuffers[i], nullptr);
+        vkFreeMemory(*_device, _computeUniformBuffersMemory[i], nullptr);
+    }
+    
+    DestroyParticleBuffers();
+    
+    vkDestroyBuffer(*_device, _particleCountBuffer, nullptr);
+    vkFreeMemory(*_device, _particleCountBufferMemory, nullptr);
+}
+
+
+void ComputeShader::Resize(const ShaderConstants& constants, std::vector<VkBuffer> shaderStorageBuffers, VkBuffer colorBuffer)
+{
+    vkDeviceWaitIdle(*_device);
+    
+    // descriptor sets go with their pool
+    vkDestroyDescriptorPool(*_device, _computeDescriptorPool, nullptr);
+    DestroyParticleBuffers();
+    
+    // the ring keeps its length, so the state index stays valid
+    assert(shaderStorageBuffers.size() == _stateBufferCount);
+    _capacity = constants.CAPACITY;
+    _shaderStorageBuffers = shaderStorageBuffers;
+    _colorBuffer = colorBuffer;
+    
+    CreateGridBuffers();
+    CreateReorderBuffers();
+    CreateVerletBuffers();
+    CreateLodBuffers();
+    CreateSharingBuffers();
+    CreateComputeDescriptorPool();
+    CreateComputeDescriptorSets();
+    
+    // the capacity is a specialization constant
+    _constants = constants;
+    DestroyComputePipelines();
+    CreateComputePipelines();
+    
+    // the new buffers hold no lists or counts yet, the particle count buffer is kept
+    _verletRebuildPending = true;
+    _countersCleared = false;
+}
+
+
+void ComputeShader::SetParticleCount(uint32_t count)
+{
+    assert(count <= _capacity);
+    
+    // the cached lists hold indices of removed fish or miss the new ones
+    if(count != _N) _verletRebuildPending = true;
+    
+    // written into the next submission, the gpu derives every group and instance count from it
+    _N = count;
+    _particleCountPending = true;
+}
+
+
+void ComputeShader::ResetState()
+{
+    _verletRebuildPending = true;
+    _countersCleared = false;
+    _stepCount = 0;
+    _verletStatistics = VerletStatistics{};
+}
+
+
+// every buffer sized by the particle capacity
+void ComputeShader::DestroyParticleBuffers()
+{
+    VkBuffer gridBuffers[] = { _particleCellBuffer, _cellCountBuffer, _cellStartBuffer, _cellFillBuffer, _blockSumsBuffer, _sortedIndicesBuffer };
+    VkDeviceMemory gridBuffersMemory[] = { _particleCellBufferMemory, _cellCountBufferMemory, _cellStartBufferMemory, _cellFillBufferMemory, _blockSumsBufferMemory, _sortedIndicesBufferMemory };
+    for (size_t i = 0; i < 6; i++)
+    {
+        vkDestroyBuffer(*_device, gridBuffers[i], nullptr);
+        vkFreeMemory(*_device, gridBuffersMemory[i], nullptr);
+    }
+    
+    VkBuffer reorderBuffers[] = { _colorScratchBuffer, _sortKeysBuffer, _sortValuesBuffer, _digitOffsetsBuffer };
+    VkDeviceMemory reorderBuffersMemory[] = { _colorScratchBufferMemory, _sortKeysBufferMemory, _sortValuesBufferMemory, _digitOffsetsBufferMemory };
+    for (size_t i = 0; i < 4; i++)
+    {
+        vkDestroyBuffer(*_device, reorderBuffers[i], nullptr);
+        vkFreeMemory(*_device, reorderBuffersMemory[i], nullptr);
+    }
+    
+    VkBuffer verletBuffers[] = { _verletStateBuffer, _neighborCountBuffer, _neighborListBuffer, _referencePositionBuffer, _verletDispatchBuffer };
+    VkDeviceMemory verletBuffersMemory[] = { _verletStateBufferMemory, _neighborCountBufferMemory, _neighborListBufferMemory, _referencePositionBufferMemory, _verletDispatchBufferMemory };
+    for (size_t i = 0; i < 5; i++)
+    {
+        vkDestroyBuffer(*_device, verletBuffers[i], nullptr);
+        vkFreeMemory(*_device, verletBuffersMemory[i], nullptr);
+    }
+    
+    for (size_t i = 0; i < _frameCount; i++)
+    {
+        vkDestroyBuffer(*_device, _verletStatisticsBuffers[i], nullptr);
+        vkFreeMemory(*_device, _verletStatisticsBuffersMemory[i], nullptr);
+    }
     
+    vkDestroyBuffer(*_device, _lodNeighborsBuffer, nullptr);
+    vkFreeMemory(*_device, _lodNeighborsBufferMemory, nullptr);
+    
+    for (size_t i = 0; i < _frameCount; i++)
+    {
+        vkDestroyBuffer(*_device, _sharingBuffers[i], nullptr);
+        vkFreeMemory(*_device, _sharingBuffersMemory[i], nullptr);
+    }
 }
 
 
 void ComputeShader::CreateComputeDescriptorSetLayout()
 {
-    std::array<VkDescriptorSetLayoutBinding, 3> layoutBindings{};
-    layoutBindings[0].binding = 0;
-    layoutBindings[0].descriptorCount = 1;
-    layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    layoutBindings[0].pImmutableSamplers = nullptr;
-    layoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-    layoutBindings[1].binding = 1;
-    layoutBindings[1].descriptorCount = 1;
-    layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    layoutBindings[1].pImmutableSamplers = nullptr;
-    layoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-    layoutBindings[2].binding = 2;
-    layoutBindings[2].descriptorCount = 1;
-    layoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    layoutBindings[2].pImmutableSamplers = nullptr;
-    layoutBindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    // 0 : parameters, 1-2 : particles read, 3-4 : particles write, 5-10 : uniform grid, 11-15 : morton reordering, 16-20 : verlet lists, 21 : temporal lod, 22 : particle count, 23 : orientations write
+    std::array<VkDescriptorSetLayoutBinding, 24> layoutBindings{};
+    for (uint32_t i = 0; i < layoutBindings.size(); i++)
+    {
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[i].pImmutableSamplers = nullptr;
+        layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 3;
+    layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
     layoutInfo.pBindings = layoutBindings.data();
 
     assert(vkCreateDescriptorSetLayout(*_device, &layoutInfo, nullptr, &_computeDescriptorSetLayout) == VK_SUCCESS);
@@ -117,44 +697,101 @@ void ComputeShader::CreateComputeDescriptorSetLayout()
 
 void ComputeShader::CreateComputePipeline()
 {
-    auto computeShaderCode = Util::ReadFile("../Shaders/compute.spv");
+    // grid, verlet and sort passes share the push constant range
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = static_cast<uint32_t>(std::max(sizeof(GridParameters), sizeof(SortParameters)));
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &_computeDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    assert(vkCreatePipelineLayout(*_device, &pipelineLayoutInfo, nullptr, &_computePipelineLayout) == VK_SUCCESS);
+
+    CreateComputePipelines();
+}
+
+
+void ComputeShader::CreateComputePipelines()
+{
+    _computePipeline = CreatePipeline("../Shaders/compute.spv");
+    _tiledComputePipeline = CreatePipeline("../Shaders/compute_tiled.spv");
+    _gridAssignPipeline = CreatePipeline("../Shaders/grid_assign.spv");
+    _gridScanPipeline = CreatePipeline("../Shaders/grid_scan.spv");
+    _gridScatterPipeline = CreatePipeline("../Shaders/grid_scatter.spv");
+    _gridNeighborPipeline = CreatePipeline("../Shaders/grid_neighbor.spv");
+    _mortonCodePipeline = CreatePipeline("../Shaders/morton_code.spv");
+    _radixSortPipeline = CreatePipeline("../Shaders/radix_sort.spv");
+    _mortonReorderPipeline = CreatePipeline("../Shaders/morton_reorder.spv");
+    _verletDisplacementPipeline = CreatePipeline("../Shaders/verlet_displacement.spv");
+    _verletDecidePipeline = CreatePipeline("../Shaders/verlet_decide.spv");
+    _verletBuildPipeline = CreatePipeline("../Shaders/verlet_build.spv");
+    _verletNeighborPipeline = CreatePipeline("../Shaders/verlet_neighbor.spv");
+    _particleCountPipeline = CreatePipeline("../Shaders/particle_count.spv");
+}
+
+
+void ComputeShader::DestroyComputePipelines()
+{
+    vkDestroyPipeline(*_device, _computePipeline, nullptr);
+    vkDestroyPipeline(*_device, _tiledComputePipeline, nullptr);
+    vkDestroyPipeline(*_device, _gridAssignPipeline, nullptr);
+    vkDestroyPipeline(*_device, _gridScanPipeline, nullptr);
+    vkDestroyPipeline(*_device, _gridScatterPipeline, nullptr);
+    vkDestroyPipeline(*_device, _gridNeighborPipeline, nullptr);
+    vkDestroyPipeline(*_device, _mortonCodePipeline, nullptr);
+    vkDestroyPipeline(*_device, _radixSortPipeline, nullptr);
+    vkDestroyPipeline(*_device, _mortonReorderPipeline, nullptr);
+    vkDestroyPipeline(*_device, _verletDisplacementPipeline, nullptr);
+    vkDestroyPipeline(*_device, _verletDecidePipeline, nullptr);
+    vkDestroyPipeline(*_device, _verletBuildPipeline, nullptr);
+    vkDestroyPipeline(*_device, _verletNeighborPipeline, nullptr);
+    vkDestroyPipeline(*_device, _particleCountPipeline, nullptr);
+}
+
+
+VkPipeline ComputeShader::CreatePipeline(const std::string& spvPath)
+{
+    auto computeShaderCode = Util::ReadFile(spvPath);
 
     VkShaderModule computeShaderModule = Util::CreateShaderModule(*_device, computeShaderCode);
+    
+    ShaderSpecialization specialization(_constants);
 
     VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
     computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
     computeShaderStageInfo.module = computeShaderModule;
     computeShaderStageInfo.pName = "main";
-
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &_computeDescriptorSetLayout;
-
-    assert(vkCreatePipelineLayout(*_device, &pipelineLayoutInfo, nullptr, &_computePipelineLayout) == VK_SUCCESS);
+    computeShaderStageInfo.pSpecializationInfo = specialization.Info();
 
     VkComputePipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
     pipelineInfo.layout = _computePipelineLayout;
     pipelineInfo.stage = computeShaderStageInfo;
 
-    assert(vkCreateComputePipelines(*_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_computePipeline) == VK_SUCCESS);
+    VkPipeline pipeline;
+    assert(vkCreateComputePipelines(*_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) == VK_SUCCESS);
 
     vkDestroyShaderModule(*_device, computeShaderModule, nullptr);
     
+    return pipeline;
 }
 
 
 void ComputeShader::CreateComputeUniformBuffers()
 {
-    VkDeviceSize bufferSize = sizeof(ParticleParameters);
+    VkDeviceSize bufferSize = sizeof(ComputeUniforms);
 
-    _computeUniformBuffers.resize(MAX_FRAMES);
-    _computeUniformBuffersMemory.resize(MAX_FRAMES);
-    _computeUniformBuffersMapped.resize(MAX_FRAMES);
+    _computeUniformBuffers.resize(_frameCount);
+    _computeUniformBuffersMemory.resize(_frameCount);
+    _computeUniformBuffersMapped.resize(_frameCount);
 
-    for (size_t i = 0; i < MAX_FRAMES; i++)
+    for (size_t i = 0; i < _frameCount; i++)
     {
         Util::CreateBuffer(*_device, *_physicalDevice, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _computeUniformBuffers[i], _computeUniformBuffersMemory[i]);
 
@@ -162,45 +799,145 @@ void ComputeShader::CreateComputeUniformBuffers()
     }
 }
 
+void ComputeShader::CreateGridBuffers()
+{
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    VkDeviceSize particleBufferSize = sizeof(uint32_t) * _capacity;
+    VkDeviceSize cellBufferSize = sizeof(uint32_t) * GridLayout::MAX_CELLS;
+    VkDeviceSize blockBufferSize = sizeof(uint32_t) * (GridLayout::MAX_CELLS / 256);
+    
+    Util::CreateBuffer(*_device, *_physicalDevice, particleBufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _particleCellBuffer, _particleCellBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, cellBufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _cellCountBuffer, _cellCountBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, cellBufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _cellStartBuffer, _cellStartBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, cellBufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _cellFillBuffer, _cellFillBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, blockBufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _blockSumsBuffer, _blockSumsBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, particleBufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _sortedIndicesBuffer, _sortedIndicesBufferMemory);
+}
+
+
+void ComputeShader::CreateReorderBuffers()
+{
+    VkDeviceSize sortBufferSize = sizeof(uint32_t) * _capacity * 2;
+    VkDeviceSize digitOffsetsSize = sizeof(uint32_t) * (1 << RADIX_BITS) * ((_capacity + SORT_BLOCK_SIZE - 1) / SORT_BLOCK_SIZE);
+    
+    Util::CreateBuffer(*_device, *_physicalDevice, ParticleLayout::StreamSize(_capacity), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _colorScratchBuffer, _colorScratchBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, sortBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _sortKeysBuffer, _sortKeysBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, sortBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _sortValuesBuffer, _sortValuesBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, digitOffsetsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _digitOffsetsBuffer, _digitOffsetsBufferMemory);
+}
+
+
+void ComputeShader::CreateVerletBuffers()
+{
+    // stepCount, rebuildCount, overflowCount, maxNeighborCount, maxDisplacement
+    VkDeviceSize stateSize = sizeof(uint32_t) * 5;
+    VkDeviceSize listSize = sizeof(uint32_t) * _capacity * VERLET_CAPACITY;
+    
+    Util::CreateBuffer(*_device, *_physicalDevice, stateSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _verletStateBuffer, _verletStateBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, sizeof(uint32_t) * _capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _neighborCountBuffer, _neighborCountBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, listSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _neighborListBuffer, _neighborListBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, ParticleLayout::StreamSize(_capacity), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _referencePositionBuffer, _referencePositionBufferMemory);
+    Util::CreateBuffer(*_device, *_physicalDevice, sizeof(VkDispatchIndirectCommand) * DISPATCH_SLOT_COUNT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _verletDispatchBuffer, _verletDispatchBufferMemory);
+    
+    _verletStatisticsBuffers.resize(_frameCount);
+    _verletStatisticsBuffersMemory.resize(_frameCount);
+    _verletStatisticsBuffersMapped.resize(_frameCount);
+    
+    for (size_t i = 0; i < _frameCount; i++)
+    {
+        Util::CreateBuffer(*_device, *_physicalDevice, sizeof(VerletStatistics), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _verletStatisticsBuffers[i], _verletStatisticsBuffersMemory[i]);
+        
+        vkMapMemory(*_device, _verletStatisticsBuffersMemory[i], 0, sizeof(VerletStatistics), 0, &_verletStatisticsBuffersMapped[i]);
+        memset(_verletStatisticsBuffersMapped[i], 0, sizeof(VerletStatistics));
+    }
+}
+
+
+void ComputeShader::CreateLodBuffers()
+{
+    Util::CreateBuffer(*_device, *_physicalDevice, sizeof(uint32_t) * _capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _lodNeighborsBuffer, _lodNeighborsBufferMemory);
+}
+
+
+// read by the cull pass, the vertex shaders and as indirect arguments, written by copies or by the host,
+// device local, or host visible and coherent and mapped with hostSharing
+void ComputeShader::CreateSharingBuffers()
+{
+    _sharingBuffers.resize(_frameCount);
+    _sharingBuffersMemory.resize(_frameCount);
+    _sharingBuffersMapped.assign(_frameCount, nullptr);
+    
+    // the host visible heap may be small on a discrete gpu, only a simulation on the host needs it
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    VkMemoryPropertyFlags properties = hostSharing ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    for (size_t i = 0; i < _frameCount; i++)
+    {
+        VkDeviceSize size = ParticleLayout::SharingSize(_capacity);
+        Util::CreateBuffer(*_device, *_physicalDevice, size, usage, properties, _sharingBuffers[i], _sharingBuffersMemory[i]);
+        if(!hostSharing) continue;
+        
+        VkResult result = vkMapMemory(*_device, _sharingBuffersMemory[i], 0, size, 0, &_sharingBuffersMapped[i]);
+        assert(result == VK_SUCCESS);
+        (void)result;
+    }
+}
+
+
+void ComputeShader::CreateParticleCountBuffer()
+{
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    Util::CreateBuffer(*_device, *_physicalDevice, sizeof(ParticleLayout::ParticleCount), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _particleCountBuffer, _particleCountBufferMemory);
+}
+
+
 void ComputeShader::CreateComputeDescriptorPool()
 {
+    // one set per frame and state buffer written
+    uint32_t setCount = _frameCount * _stateBufferCount;
+    
     std::array<VkDescriptorPoolSize, 2> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES);
+    poolSizes[0].descriptorCount = setCount;
     
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES) * 2;
+    poolSizes[1].descriptorCount = setCount * 23;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = 2;
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES);
+    poolInfo.maxSets = setCount;
 
     assert(vkCreateDescriptorPool(*_device, &poolInfo, nullptr, &_computeDescriptorPool) == VK_SUCCESS);
 }
 
 void ComputeShader::CreateComputeDescriptorSets()
 {
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES, _computeDescriptorSetLayout);
+    // set frame * _stateBufferCount + target writes state buffer target and reads the one before it in the ring
+    uint32_t setCount = _frameCount * _stateBufferCount;
+    std::vector<VkDescriptorSetLayout> layouts(setCount, _computeDescriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = _computeDescriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES);
+    allocInfo.descriptorSetCount = setCount;
     allocInfo.pSetLayouts = layouts.data();
 
-    _computeDescriptorSets.resize(MAX_FRAMES);
+    _computeDescriptorSets.resize(setCount);
     
     assert(vkAllocateDescriptorSets(*_device, &allocInfo, _computeDescriptorSets.data()) == VK_SUCCESS);
 
-    for (size_t i = 0; i < MAX_FRAMES; i++)
+    for (uint32_t i = 0; i < setCount; i++)
     {
+        uint32_t frame = i / _stateBufferCount;
+        uint32_t target = i % _stateBufferCount;
+        
+
         VkDescriptorBufferInfo uniformBufferInfo{};
-        uniformBufferInfo.buffer = _computeUniformBuffers[i];
+        uniformBufferInfo.buffer = _computeUniformBuffers[frame];
         uniformBufferInfo.offset = 0;
-        uniformBufferInfo.range = sizeof(ParticleParameters);
+        uniformBufferInfo.range = sizeof(ComputeUniforms);
 
-        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+        std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
         descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[0].dstSet = _computeDescriptorSets[i];
         descriptorWrites[0].dstBinding = 0;
@@ -209,40 +946,59 @@ void ComputeShader::CreateComputeDescriptorSets()
         descriptorWrites[0].descriptorCount = 1;
         descriptorWrites[0].pBufferInfo = &uniformBufferInfo;
 
-        VkDescriptorBufferInfo storageBufferInfoLastFrame{};
-        storageBufferInfoLastFrame.buffer = _shaderStorageBuffers[(i - 1) % MAX_FRAMES];
-        storageBufferInfoLastFrame.offset = 0;
-        storageBufferInfoLastFrame.range = sizeof(InstanceParameters) * _N;
-
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = _computeDescriptorSets[i];
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pBufferInfo = &storageBufferInfoLastFrame;
-
-        VkDescriptorBufferInfo storageBufferInfoCurrentFrame{};
-        storageBufferInfoCurrentFrame.buffer = _shaderStorageBuffers[i];
-        storageBufferInfoCurrentFrame.offset = 0;
-        storageBufferInfoCurrentFrame.range = sizeof(InstanceParameters) * _N;
-
-        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[2].dstSet = _computeDescriptorSets[i];
-        descriptorWrites[2].dstBinding = 2;
-        descriptorWrites[2].dstArrayElement = 0;
-        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        descriptorWrites[2].descriptorCount = 1;
-        descriptorWrites[2].pBufferInfo = &storageBufferInfoCurrentFrame;
-
-        vkUpdateDescriptorSets(*_device, 3, descriptorWrites.data(), 0, nullptr);
+        vkUpdateDescriptorSets(*_device, 1, descriptorWrites.data(), 0, nullptr);
+        
+        
+        // 1-4 : particle streams of the newest state (read) and the next one (write), 5-10 : uniform grid, 11-15 : morton reordering, 16-20 : verlet lists, 21 : temporal lod, 22 : particle count, 23 : orientations of the next state
+        VkBuffer readBuffer = _shaderStorageBuffers[(target + _stateBufferCount - 1) % _stateBufferCount];
+        VkBuffer writeBuffer = _shaderStorageBuffers[target];
+        std::array<VkDescriptorBufferInfo, 23> storageBufferInfos =
+        {
+            ParticleLayout::StreamInfo(readBuffer, ParticleLayout::POSITION, _capacity),
+            ParticleLayout::StreamInfo(readBuffer, ParticleLayout::VELOCITY, _capacity),
+            ParticleLayout::StreamInfo(writeBuffer, ParticleLayout::POSITION, _capacity),
+            ParticleLayout::StreamInfo(writeBuffer, ParticleLayout::VELOCITY, _capacity),
+            VkDescriptorBufferInfo{ _particleCellBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _cellCountBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _cellStartBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _cellFillBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _blockSumsBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _sortedIndicesBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _colorBuffer, 0, ParticleLayout::StreamSize(_capacity) },
+            VkDescriptorBufferInfo{ _colorScratchBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _sortKeysBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _sortValuesBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _digitOffsetsBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _verletStateBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _neighborCountBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _neighborListBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _referencePositionBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _verletDispatchBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _lodNeighborsBuffer, 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _particleCountBuffer, 0, VK_WHOLE_SIZE },
+            ParticleLayout::StreamInfo(writeBuffer, ParticleLayout::ORIENTATION, _capacity),
+        };
+        
+        std::array<VkWriteDescriptorSet, 23> storageDescriptorWrites{};
+        for (uint32_t b = 0; b < storageDescriptorWrites.size(); b++)
+        {
+            storageDescriptorWrites[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            storageDescriptorWrites[b].dstSet = _computeDescriptorSets[i];
+            storageDescriptorWrites[b].dstBinding = 1 + b;
+            storageDescriptorWrites[b].dstArrayElement = 0;
+            storageDescriptorWrites[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            storageDescriptorWrites[b].descriptorCount = 1;
+            storageDescriptorWrites[b].pBufferInfo = &storageBufferInfos[b];
+        }
+        
+        vkUpdateDescriptorSets(*_device, static_cast<uint32_t>(storageDescriptorWrites.size()), storageDescriptorWrites.data(), 0, nullptr);
     }
 }
 
 
 void ComputeShader::CreateComputeCommandBuffers()
 {
-    _computeCommandBuffers.resize(MAX_FRAMES);
+    _computeCommandBuffers.resize(_frameCount);
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -253,8 +1009,50 @@ void ComputeShader::CreateComputeCommandBuffers()
     assert(vkAllocateCommandBuffers(*_device, &allocInfo, _computeCommandBuffers.data()) == VK_SUCCESS);
 }
 
+void ComputeShader::SetAdvanceBatchSize(uint32_t batchSize)
+{
+    assert(batchSize > 0);
+    _advanceBatchSize = batchSize;
+}
+
 void ComputeShader::SetParameters(ParticleParameters params)
 { 
     _params = params;
 }
 
+void ComputeShader::SetNeighborSearch(NeighborSearch mode)
+{
+    // other modes do not keep the lists up to date
+    if(mode != _neighborSearch) _verletRebuildPending = true;
+    _neighborSearch = mode;
+}
+
+void ComputeShader::SetLodParameters(const LodParameters& lod)
+{
+    _lod = lod;
+}
+
+void ComputeShader::SetVerletSkin(float skin)
+{
+    _verletSkin = skin;
+}
+
+void ComputeShader::SetReorderInterval(uint32_t interval)
+{
+    _reorderInterval = interval;
+}
+
+void ComputeShader::SetShaderConstants(const ShaderConstants& constants)
+{
+    // the capacity sizes every buffer, see Resize
+    assert(constants.CAPACITY == _capacity);
+    if(constants == _constants) return;
+    
+    _constants = constants;
+    
+    vkDeviceWaitIdle(*_device);
+    DestroyComputePipelines();
+    CreateComputePipelines();
+    _verletRebuildPending = true;
+}
+
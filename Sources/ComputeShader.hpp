@@ -6,47 +6,189 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
-struct ParticleParameters
+#include "ShaderConstants.hpp"
+#include "ParticleLayout.hpp"
+#include "Timeline.hpp"
+#include "GpuTimer.hpp"
+#include "BoidSimulator.hpp"
+#include "GridLayout.hpp"
+
+// how the flocking pass finds the neighbors of a particle
+enum class NeighborSearch
+{
+    BruteForce,         // every particle against every particle, O(N^2)
+    TiledBruteForce,    // same as BruteForce, particles are staged through shared memory in tiles of 256
+    UniformGrid,        // counting sort into a uniform grid, only the 27 surrounding cells are visited
+    VerletList,         // per particle lists built from the grid with a skin, rebuilt once a particle moved half the skin
+};
+
+// push constants of the grid_* passes
+struct GridParameters
+{
+    uint32_t GRID_DIM;
+    float CELL_SIZE;
+    uint32_t CELL_COUNT;
+    uint32_t STAGE;
+    // verlet_* passes only
+    float LIST_RADIUS;
+    float HALF_SKIN;
+    uint32_t LIST_CAPACITY;
+    uint32_t FORCE_REBUILD;
+    // every flocking pass
+    uint32_t STEP;
+};
+
+// push constants of the morton reordering passes
+struct SortParameters
 {
-    float MAX_SPEED;
-    float ATTRACTION;
-    float WALL_AVOIDANCE;
-    float ATTRACTION_DISTANCE;
-    float ALIGNMENT_DISTANCE;
-    float ALIGNMENT;
-    float AVOIDANCE_DISTANCE;
-    float AVOIDANCE;
-    float VORTEX_FORCE;
+    uint32_t STAGE;
+    uint32_t SHIFT;
+    uint32_t IN_OFFSET;
+    uint32_t OUT_OFFSET;
 };
 
-struct InstanceParameters
+// counters of the verlet list mode, cumulative since Init
+struct VerletStatistics
 {
-    alignas(16) glm::vec3 pos;
-    alignas(16) glm::vec3 vel;
-    alignas(16) glm::vec3 rgb;
+    uint32_t stepCount;
+    uint32_t rebuildCount;
+    uint32_t overflowCount;     // particles that found more neighbors than their list holds, summed over rebuilds
+    uint32_t maxNeighborCount;
 };
 
-class ComputeShader
+class ComputeShader : public BoidSimulator
 {
 
 public:
-    void Init(VkDevice* device, VkPhysicalDevice* physicalDevice, uint32_t particleNum, std::vector<VkBuffer> shaderStorageBuffers, VkCommandPool* _commandPool);
-    void Execute(uint32_t frame, VkSemaphore* computeFinishedSemaphore, VkFence* computeInFlightFence, VkQueue queue);
+    // frameCount command buffers, uniforms and sharing buffers are in flight, every step writes the next of the shaderStorageBuffers ring,
+    // state and color buffers hold constants.CAPACITY particles, see SetParticleCount for how many are simulated,
+    // the command pool and queue and every submission belong to computeFamily, the renderer draws on graphicsFamily (may be the same)
+    void Init(VkDevice* device, VkPhysicalDevice* physicalDevice, const ShaderConstants& constants, uint32_t frameCount, std::vector<VkBuffer> shaderStorageBuffers, VkBuffer colorBuffer, VkCommandPool* commandPool, VkQueue* queue, uint32_t computeFamily, uint32_t graphicsFamily);
+    // records stepCount fixed ticks into the command buffer of this frame, stepCount may be 0,
+    // then fills the sharing buffer of this frame once graphicsTimeline reached graphicsValue (the frame that drew from it last),
+    // signals the next value of GetTimeline
+    void Execute(uint32_t frame, uint32_t stepCount, VkSemaphore graphicsTimeline, uint64_t graphicsValue);
+    // for warm-up and fast-forward, SetAdvanceBatchSize ticks per submission
+    double Advance(uint32_t stepCount) override;
+    double GetAdvanceRate() const override { return _advanceRate; }
+    void SetAdvanceBatchSize(uint32_t batchSize);
+    // gpu time of each pass of the last completed submission of the frame being recorded
+    enum TimedPass { STEPS_PASS = 0, SHARING_PASS = 1, TIMED_PASS_COUNT };
+    double GetPassMilliseconds(TimedPass pass) const { return _timer.GetMilliseconds(pass); }
+    // reads the pass times of the last submission of frame, which must have completed, Execute does it before reusing the frame
+    void CollectPassTimes(uint32_t frame) { _timer.Collect(frame); }
+    // every submission of this queue, Pending is the value the sharing buffer of the last Execute is ready at
+    const Timeline& GetTimeline() const { return _timeline; }
     void Release();
     
-    void SetParameters(ParticleParameters params);
+    // new capacity and buffers, waits for the device and rebuilds everything sized by the capacity
+    void Resize(const ShaderConstants& constants, std::vector<VkBuffer> shaderStorageBuffers, VkBuffer colorBuffer);
+    
+    // live particle count, applied on the gpu by the next submission without a pipeline rebuild
+    void SetParticleCount(uint32_t count) override;
+    // rebuilds the verlet lists and clears the counters on the next submission
+    void ResetState() override;
+    uint32_t GetParticleCount() const override { return _N; }
+    // newest of the state buffers and steps run so far, to compare against CpuBoidSimulator
+    uint32_t GetStateIndex() const { return _stateIndex; }
+    uint64_t GetStepCount() const { return _stepCount; }
+    // what each frame in flight draws, released to the graphics family by Execute, see ParticleLayout::SharedStream
+    std::vector<VkBuffer> GetSharingBuffers() const { return _sharingBuffers; }
+    // persistently mapped with hostSharing, for a simulation on the host to write the frames into instead of Execute
+    std::vector<void*> GetSharingBuffersMapped() const { return _sharingBuffersMapped; }
+    // set before Init, the sharing buffers live in host visible memory and are mapped, otherwise they are device local only
+    bool hostSharing = false;
+    
+    void SetParameters(ParticleParameters params) override;
+    void SetNeighborSearch(NeighborSearch mode);
+    void SetShaderConstants(const ShaderConstants& constants) override;
+    void SetLodParameters(const LodParameters& lod) override;
+    NeighborSearch GetNeighborSearch() const { return _neighborSearch; }
+    
+
+    // particles are sorted into morton order every interval steps, 0 disables it
+    void SetReorderInterval(uint32_t interval);
+    uint32_t GetReorderInterval() const { return _reorderInterval; }
+    
+    // verlet lists hold every particle within the largest interaction distance + skin
+    void SetVerletSkin(float skin);
+    float GetVerletSkin() const { return _verletSkin; }
+    uint32_t GetVerletCapacity() const { return VERLET_CAPACITY; }
+    // read back from the gpu, a few frames behind
+    VerletStatistics GetVerletStatistics() const { return _verletStatistics; }
     
 private:
     VkDevice* _device;
     VkPhysicalDevice* _physicalDevice;
     VkCommandPool* _commandPool;
+    VkQueue* _queue;
+    uint32_t _computeFamily;
+    uint32_t _graphicsFamily;
     
-    const int MAX_FRAMES = 2;
+    // uniform buffer of the compute passes (std140), ParticleParameters followed by the lod parameters
+    struct ComputeUniforms
+    {
+        float MAX_SPEED;
+        float ATTRACTION;
+        float WALL_AVOIDANCE;
+        float ATTRACTION_DISTANCE;
+        float ALIGNMENT_DISTANCE;
+        float ALIGNMENT;
+        float AVOIDANCE_DISTANCE;
+        float AVOIDANCE;
+        float VORTEX_FORCE;
+        alignas(16) glm::vec4 LOD_CAMERA;
+        float LOD_NEAR_DISTANCE;
+        float LOD_DISTANCE_STEP;
+        uint32_t LOD_MAX_INTERVAL;
+        uint32_t LOD_MODE;
+    };
+    
+    uint32_t _frameCount = 0;
+    uint32_t _stateBufferCount = 0;
+    // count last requested by the host, passes may change the one on the gpu
     uint32_t _N = 0;
+    bool _particleCountPending = true;
+    uint32_t _capacity = 0;
+    ShaderConstants _constants;
+    
+    NeighborSearch _neighborSearch = NeighborSearch::BruteForce;
+    
+    const uint32_t SORT_BLOCK_SIZE = 256;
+    const uint32_t RADIX_BITS = 4;
+    const uint32_t MORTON_BITS = 30;
+    uint32_t _reorderInterval = 0;
+    uint64_t _stepCount = 0;
+    // all state buffers start with the same state, the first step writes buffer 0
+    uint32_t _stateIndex = 0;
+    
+    // rebuild passes take their group counts from the decision of the gpu
+    enum DispatchSlot { PARTICLE_GROUPS = 0, CELL_GROUPS = 1, SINGLE_GROUP = 2, DISPATCH_SLOT_COUNT };
+    const uint32_t VERLET_CAPACITY = 128;
+    float _verletSkin = 0.01f;
+    float _verletListRadius = 0.0f;
+    bool _verletRebuildPending = true;
+    bool _countersCleared = false;
+    VerletStatistics _verletStatistics{};
+    
+    LodParameters _lod;
     
     VkDescriptorSetLayout _computeDescriptorSetLayout;
     VkPipelineLayout _computePipelineLayout;
     VkPipeline _computePipeline;
+    VkPipeline _tiledComputePipeline;
+    VkPipeline _gridAssignPipeline;
+    VkPipeline _gridScanPipeline;
+    VkPipeline _gridScatterPipeline;
+    VkPipeline _gridNeighborPipeline;
+    VkPipeline _mortonCodePipeline;
+    VkPipeline _radixSortPipeline;
+    VkPipeline _mortonReorderPipeline;
+    VkPipeline _verletDisplacementPipeline;
+    VkPipeline _verletDecidePipeline;
+    VkPipeline _verletBuildPipeline;
+    VkPipeline _verletNeighborPipeline;
+    VkPipeline _particleCountPipeline;
     VkDescriptorPool _computeDescriptorPool;
     std::vector<VkDescriptorSet> _computeDescriptorSets;
     
@@ -56,15 +198,99 @@ private:
     
     std::vector<VkBuffer> _shaderStorageBuffers;
     std::vector<VkCommandBuffer> _computeCommandBuffers;
+    Timeline _timeline;
+    GpuTimer _timer;
+    // value of the last submission that used the command buffer, uniforms and statistics of each frame
+    std::vector<uint64_t> _frameValues;
+    double _advanceRate = 0.0;
+    uint32_t _advanceBatchSize = 64;
+    
+    // uniform grid, shared by all frames since compute submissions are serialized on the queue
+    VkBuffer _particleCellBuffer;
+    VkDeviceMemory _particleCellBufferMemory;
+    VkBuffer _cellCountBuffer;
+    VkDeviceMemory _cellCountBufferMemory;
+    VkBuffer _cellStartBuffer;
+    VkDeviceMemory _cellStartBufferMemory;
+    VkBuffer _cellFillBuffer;
+    VkDeviceMemory _cellFillBufferMemory;
+    VkBuffer _blockSumsBuffer;
+    VkDeviceMemory _blockSumsBufferMemory;
+    VkBuffer _sortedIndicesBuffer;
+    VkDeviceMemory _sortedIndicesBufferMemory;
+    
+    // morton reordering
+    VkBuffer _colorBuffer;
+    VkBuffer _colorScratchBuffer;
+    VkDeviceMemory _colorScratchBufferMemory;
+    VkBuffer _sortKeysBuffer;
+    VkDeviceMemory _sortKeysBufferMemory;
+    VkBuffer _sortValuesBuffer;
+    VkDeviceMemory _sortValuesBufferMemory;
+    VkBuffer _digitOffsetsBuffer;
+    VkDeviceMemory _digitOffsetsBufferMemory;
+    
+    // verlet lists, the state is copied into a mapped buffer per frame for the statistics
+    VkBuffer _verletStateBuffer;
+    VkDeviceMemory _verletStateBufferMemory;
+    VkBuffer _neighborCountBuffer;
+    VkDeviceMemory _neighborCountBufferMemory;
+    VkBuffer _neighborListBuffer;
+    VkDeviceMemory _neighborListBufferMemory;
+    VkBuffer _referencePositionBuffer;
+    VkDeviceMemory _referencePositionBufferMemory;
+    VkBuffer _verletDispatchBuffer;
+    VkDeviceMemory _verletDispatchBufferMemory;
+    std::vector<VkBuffer> _verletStatisticsBuffers;
+    std::vector<VkDeviceMemory> _verletStatisticsBuffersMemory;
+    std::vector<void*> _verletStatisticsBuffersMapped;
+    
+    // neighbors of every particle at its last update, for TemporalLod::NeighborCount
+    VkBuffer _lodNeighborsBuffer;
+    VkDeviceMemory _lodNeighborsBufferMemory;
+    
+    // live particle count and indirect arguments, independent of the capacity
+    VkBuffer _particleCountBuffer;
+    VkDeviceMemory _particleCountBufferMemory;
+    
+    // one per frame in flight, owned by the graphics family between Execute and the next use of the frame
+    std::vector<VkBuffer> _sharingBuffers;
+    std::vector<VkDeviceMemory> _sharingBuffersMemory;
+    std::vector<void*> _sharingBuffersMapped;
     
     
     void CreateComputeDescriptorSetLayout();
     void CreateComputePipeline();
+    void CreateComputePipelines();
+    void DestroyComputePipelines();
+    VkPipeline CreatePipeline(const std::string& spvPath);
     void CreateComputeUniformBuffers();
+    void CreateGridBuffers();
+    void CreateReorderBuffers();
+    void CreateVerletBuffers();
+    void CreateLodBuffers();
+    void CreateSharingBuffers();
+    void DestroyParticleBuffers();
+    void CreateParticleCountBuffer();
     void CreateComputeDescriptorPool();
     void CreateComputeDescriptorSets();
     void CreateComputeCommandBuffers();
     
+    GridParameters CalculateGridParameters(float padding = 0.0f) const;
+    void WriteParameters(uint32_t frame);
+    void RecordSteps(uint32_t frame, uint32_t stepCount, bool share);
+    void Submit(uint32_t frame, VkSemaphore waitSemaphore, uint64_t waitValue);
+    void RecordSharing(VkCommandBuffer commandBuffer, uint32_t frame);
+    void RecordStep(VkCommandBuffer commandBuffer, uint32_t frame);
+    VkDescriptorSet StepDescriptorSet(uint32_t frame) const;
+    void RecordParticleCount(VkCommandBuffer commandBuffer, uint32_t frame);
+    void DispatchParticles(VkCommandBuffer commandBuffer);
+    void RecordGridPasses(VkCommandBuffer commandBuffer, uint32_t frame);
+    void RecordGridSort(VkCommandBuffer commandBuffer, const GridParameters& grid, bool indirect);
+    void RecordVerletPasses(VkCommandBuffer commandBuffer, uint32_t frame);
+    void RecordMortonReorder(VkCommandBuffer commandBuffer, uint32_t frame);
+    void ComputeBarrier(VkCommandBuffer commandBuffer);
+    
     
     float MAX_SPEED = 0.0018f;
     float WALL_AVOIDANCE = 0.00002f;
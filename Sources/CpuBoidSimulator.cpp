@@ -0,0 +1,237 @@
+#include "CpuBoidSimulator.hpp"
+#include "ParticleLayout.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+
+void CpuBoidSimulator::Init(const ShaderConstants& constants, uint32_t threadCount)
+{
+    _pool = std::make_unique<WorkStealingPool>(threadCount);
+    SetKernel(NeighborKernel::Best());
+    SetShaderConstants(constants);
+}
+
+
+void CpuBoidSimulator::SetKernel(NeighborKernel::Isa isa)
+{
+    _isa = NeighborKernel::IsSupported(isa) ? isa : NeighborKernel::Isa::Scalar;
+    _kernel = NeighborKernel::Get(_isa);
+}
+
+
+void CpuBoidSimulator::SetShaderConstants(const ShaderConstants& constants)
+{
+    _constants = constants;
+    
+    for (State& state : _states)
+    {
+        state.positions.resize(_constants.CAPACITY, glm::vec4(0.0f));
+        state.velocities.resize(_constants.CAPACITY, glm::vec4(0.0f));
+        state.orientations.resize(_constants.CAPACITY, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+    _lodNeighbors.resize(_constants.CAPACITY, 0);
+    _N = std::min(_N, _constants.CAPACITY);
+}
+
+
+void CpuBoidSimulator::SetParticleCount(uint32_t count)
+{
+    assert(count <= _constants.CAPACITY);
+    _N = count;
+}
+
+
+void CpuBoidSimulator::ResetState()
+{
+    _stepCount = 0;
+    std::fill(_lodNeighbors.begin(), _lodNeighbors.end(), 0);
+}
+
+
+void CpuBoidSimulator::SetState(const glm::vec4* positions, const glm::vec4* velocities, uint32_t count, uint64_t stepCount)
+{
+    SetParticleCount(count);
+    
+    State& state = _states[_read];
+    std::copy(positions, positions + count, state.positions.begin());
+    std::copy(velocities, velocities + count, state.velocities.begin());
+    for (uint32_t i = 0; i < count; i++)
+    {
+        state.orientations[i] = ParticleLayout::Orientation(glm::vec3(velocities[i]));
+    }
+    
+    _stepCount = stepCount;
+}
+
+
+double CpuBoidSimulator::Advance(uint32_t stepCount)
+{
+    auto begin = std::chrono::steady_clock::now();
+    
+    for (uint32_t i = 0; i < stepCount; i++)
+    {
+        Step();
+    }
+    
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    _advanceRate = elapsed.count() > 0.0 ? stepCount / elapsed.count() : 0.0;
+    
+    return _advanceRate;
+}
+
+
+// one tick from the newest state into the other one, like a dispatch of compute.glsl
+void CpuBoidSimulator::Step()
+{
+    _stepCount++;
+    
+    const State& read = _states[_read];
+    State& write = _states[1 - _read];
+    
+    auto begin = std::chrono::steady_clock::now();
+    if(_useCellList)
+    {
+        _cellList.Build(read.positions.data(), read.velocities.data(), _N, _params, _constants, *_pool);
+    }
+    else
+    {
+        _streams.Resize(_N);
+        _pool->ParallelFor(0, _N, STREAM_GRAIN, [&](uint32_t first, uint32_t last)
+        {
+            _streams.Load(read.positions.data(), read.velocities.data(), first, last);
+        });
+    }
+    auto built = std::chrono::steady_clock::now();
+    
+    NeighborRules rules;
+    rules.attractionDistance = _constants.ENABLE_ATTRACTION ? _params.ATTRACTION_DISTANCE : -1.0f;
+    rules.alignmentDistance = _constants.ENABLE_ALIGNMENT ? _params.ALIGNMENT_DISTANCE : -1.0f;
+    rules.avoidanceDistance = _constants.ENABLE_AVOIDANCE ? _params.AVOIDANCE_DISTANCE : -1.0f;
+    rules.maxSpeed = _params.MAX_SPEED;
+    rules.fixedLimit = FixedPoint::Limit(_constants.CAPACITY);
+    NeighborKernel::Function kernel = _constants.DETERMINISTIC ? NeighborKernel::GetFixedPoint() : _kernel;
+    
+    _pool->ParallelFor(0, _N, GRAIN, [&](uint32_t first, uint32_t last)
+    {
+        StepRange(first, last, read, write, kernel, rules);
+    });
+    auto done = std::chrono::steady_clock::now();
+    
+    _buildMs = std::chrono::duration<double, std::milli>(built - begin).count();
+    _queryMs = std::chrono::duration<double, std::milli>(done - built).count();
+    
+    _read = 1 - _read;
+}
+
+
+// main() of compute.glsl (or grid_neighbor.glsl) for the particles in slots [first, last),
+// with the cell list a slot is a position in cell order
+void CpuBoidSimulator::StepRange(uint32_t first, uint32_t last, const State& read, State& write, NeighborKernel::Function kernel, const NeighborRules& rules)
+{
+    for (uint32_t slot = first; slot < last; slot++)
+    {
+        uint32_t id = _useCellList ? _cellList.GetSortedIndices()[slot] : slot;
+        glm::vec3 pos = read.positions[id];
+        glm::vec3 vel = read.velocities[id];
+        
+        // lodDue
+        if((static_cast<uint32_t>(_stepCount) + id / _constants.WORKGROUP_SIZE) % LodInterval(id, pos) != 0)
+        {
+            Drift(id, pos, vel, write);
+            continue;
+        }
+        
+        // addNeighborAt over every particle that may be close enough, itself included
+        Neighborhood n;
+        if(_useCellList) _cellList.Gather(pos, kernel, rules, n);
+        else kernel(_streams, 0, _N, pos, rules, n);
+        
+        // lodRecord, only this particle writes its entry
+        if(_lod.MODE == TemporalLod::NeighborCount)
+        {
+            _lodNeighbors[id] = static_cast<uint32_t>(std::max(n.attractionNearCnt, std::max(n.alignmentNearCnt, n.avoidanceNearCnt)));
+        }
+        
+        Integrate(id, pos, vel, n, write);
+    }
+}
+
+
+// lodInterval of lod_common.glsl, with the clamps WriteParameters applies to the uniforms
+uint32_t CpuBoidSimulator::LodInterval(uint32_t id, glm::vec3 pos) const
+{
+    uint32_t maxInterval = std::max(_lod.MAX_INTERVAL, 1u);
+    
+    if(_lod.MODE == TemporalLod::CameraDistance)
+    {
+        float beyond = std::max(glm::length(pos - _lod.CAMERA_POS) - _lod.NEAR_DISTANCE, 0.0f);
+        return std::min(1 + static_cast<uint32_t>(beyond / std::max(_lod.DISTANCE_STEP, 1e-4f)), maxInterval);
+    }
+    
+    if(_lod.MODE == TemporalLod::NeighborCount && _lodNeighbors[id] == 1)
+    {
+        return maxInterval;
+    }
+    
+    return 1;
+}
+
+
+// integrate of boids_common.glsl
+void CpuBoidSimulator::Integrate(uint32_t id, glm::vec3 pos, glm::vec3 vel, const Neighborhood& n, State& write) const
+{
+    glm::vec3 acc = glm::vec3(0.0f);
+    
+    if(_constants.ENABLE_WALL_AVOIDANCE)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if(pos[axis] > _constants.FIELD_SCALE) acc[axis] += -_params.WALL_AVOIDANCE;
+            if(pos[axis] < 0.0f) acc[axis] += _params.WALL_AVOIDANCE;
+        }
+    }
+    
+    bool fixed = _constants.DETERMINISTIC;
+    float limit = FixedPoint::Limit(_constants.CAPACITY);
+    if(n.attractionNearCnt > 0)
+    {
+        glm::vec3 meanPos = fixed ? pos + FixedPoint::From(n.attractionFixed, _params.ATTRACTION_DISTANCE, limit) / static_cast<float>(n.attractionNearCnt)
+                                  : n.attractionPosSum / static_cast<float>(n.attractionNearCnt);
+        acc += (meanPos - pos) * _params.ATTRACTION;
+    }
+    if(n.alignmentNearCnt > 0)
+    {
+        glm::vec3 velSum = fixed ? FixedPoint::From(n.alignmentFixed, _params.MAX_SPEED, limit) : n.alignmentVelSum;
+        glm::vec3 meanVel = velSum / static_cast<float>(n.alignmentNearCnt);
+        acc += meanVel * _params.ALIGNMENT;
+    }
+    if(n.avoidanceNearCnt > 0)
+    {
+        glm::vec3 avoidanceSum = fixed ? FixedPoint::From(n.avoidanceFixed, _params.AVOIDANCE_DISTANCE, limit) : n.avoidanceSum;
+        acc += avoidanceSum * _params.AVOIDANCE;
+    }
+    
+    if(_constants.ENABLE_VORTEX)
+    {
+        glm::vec3 vortexForce = glm::cross(pos - glm::vec3(0.5f), glm::vec3(1.0f, 0.0f, 0.0f));
+        acc += vortexForce * _params.VORTEX_FORCE;
+    }
+    
+    vel += acc;
+    if(glm::length(vel) > _params.MAX_SPEED) vel = glm::normalize(vel) * _params.MAX_SPEED;
+    
+    write.positions[id] = glm::vec4(pos + vel, 1.0f);
+    write.velocities[id] = glm::vec4(vel, 0.0f);
+    write.orientations[id] = ParticleLayout::Orientation(vel);
+}
+
+
+// drift of boids_common.glsl
+void CpuBoidSimulator::Drift(uint32_t id, glm::vec3 pos, glm::vec3 vel, State& write) const
+{
+    write.positions[id] = glm::vec4(pos + vel, 1.0f);
+    write.velocities[id] = glm::vec4(vel, 0.0f);
+    write.orientations[id] = ParticleLayout::Orientation(vel);
+}
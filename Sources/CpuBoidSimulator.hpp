@@ -0,0 +1,98 @@
+#pragma once
+#include "BoidSimulator.hpp"
+#include "CellList.hpp"
+#include "NeighborKernel.hpp"
+#include "StateHash.hpp"
+#include "WorkStealingPool.hpp"
+
+#include <memory>
+#include <vector>
+
+// the rules of compute.glsl (with boids_common.glsl and lod_common.glsl) on the cpu, brute force or over a CellList,
+// for machines without a usable gpu and to check what the gpu computes,
+// particles are split across a work stealing pool and every step reads one state and writes the other
+class CpuBoidSimulator : public BoidSimulator
+{
+public:
+    // 0 threads uses every hardware thread
+    void Init(const ShaderConstants& constants, uint32_t threadCount = 0);
+    
+    void SetParameters(ParticleParameters params) override { _params = params; }
+    void SetLodParameters(const LodParameters& lod) override { _lod = lod; }
+    void SetShaderConstants(const ShaderConstants& constants) override;
+    
+    void SetParticleCount(uint32_t count) override;
+    uint32_t GetParticleCount() const override { return _N; }
+    void ResetState() override;
+    
+    double Advance(uint32_t stepCount) override;
+    double GetAdvanceRate() const override { return _advanceRate; }
+    
+    // copies count particles in (e.g. from a state buffer), stepCount picks the lod schedule the next step follows
+    void SetState(const glm::vec4* positions, const glm::vec4* velocities, uint32_t count, uint64_t stepCount);
+    const std::vector<glm::vec4>& GetPositions() const { return _states[_read].positions; }
+    const std::vector<glm::vec4>& GetVelocities() const { return _states[_read].velocities; }
+    const std::vector<glm::vec4>& GetOrientations() const { return _states[_read].orientations; }
+    // the state the last step read, for interpolating between the two
+    const std::vector<glm::vec4>& GetPreviousPositions() const { return _states[1 - _read].positions; }
+    const std::vector<glm::vec4>& GetPreviousOrientations() const { return _states[1 - _read].orientations; }
+    uint64_t GetStepCount() const { return _stepCount; }
+    // StateHash of the newest state
+    uint64_t GetStateHash() const { return StateHash::Of(GetPositions().data(), GetVelocities().data(), _N); }
+    uint32_t GetThreadCount() const { return _pool->GetThreadCount(); }
+    // the neighbor loop, NeighborKernel::Best() unless set, ShaderConstants::DETERMINISTIC replaces it by NeighborKernel::GetFixedPoint()
+    void SetKernel(NeighborKernel::Isa isa);
+    NeighborKernel::Isa GetKernel() const { return _isa; }
+    // the one Step runs, the instruction set is ignored with ShaderConstants::DETERMINISTIC
+    const char* GetKernelName() const { return _constants.DETERMINISTIC ? "fixed point (scalar)" : NeighborKernel::Name(_isa); }
+    // neighbors from a cell list rebuilt every step (on by default) or from every particle like compute.glsl
+    void SetCellList(bool enabled) { _useCellList = enabled; }
+    bool IsCellListEnabled() const { return _useCellList; }
+    // time the last step spent building the neighbor structure (cell list or streams) and running the rules over it
+    double GetBuildMilliseconds() const { return _buildMs; }
+    double GetQueryMilliseconds() const { return _queryMs; }
+    
+private:
+    struct State
+    {
+        std::vector<glm::vec4> positions;
+        std::vector<glm::vec4> velocities;
+        std::vector<glm::vec4> orientations;
+    };
+    
+    // particles per task, about one gpu workgroup so the pool overhead stays small next to the O(N) loop
+    static constexpr uint32_t GRAIN = 64;
+    // particles per task when copying the read state into the kernel streams
+    static constexpr uint32_t STREAM_GRAIN = 4096;
+    
+    void Step();
+    void StepRange(uint32_t first, uint32_t last, const State& read, State& write, NeighborKernel::Function kernel, const NeighborRules& rules);
+    
+    uint32_t LodInterval(uint32_t id, glm::vec3 pos) const;
+    void Integrate(uint32_t id, glm::vec3 pos, glm::vec3 vel, const Neighborhood& n, State& write) const;
+    void Drift(uint32_t id, glm::vec3 pos, glm::vec3 vel, State& write) const;
+    
+    std::unique_ptr<WorkStealingPool> _pool;
+    
+    ShaderConstants _constants;
+    ParticleParameters _params{};
+    LodParameters _lod;
+    
+    // _states[_read] is the newest, each step writes the other one and flips _read
+    State _states[2];
+    uint32_t _read = 0;
+    // copy of the read state the kernel streams through without the cell list
+    NeighborStreams _streams;
+    CellList _cellList;
+    bool _useCellList = true;
+    NeighborKernel::Isa _isa = NeighborKernel::Isa::Scalar;
+    NeighborKernel::Function _kernel = nullptr;
+    // lodNeighbors of lod_common.glsl
+    std::vector<uint32_t> _lodNeighbors;
+    
+    uint32_t _N = 0;
+    uint64_t _stepCount = 0;
+    double _advanceRate = 0.0;
+    double _buildMs = 0.0;
+    double _queryMs = 0.0;
+};
@@ -0,0 +1,80 @@
+#include "GpuTimer.hpp"
+
+void GpuTimer::Init(VkDevice* device, VkPhysicalDevice* physicalDevice, uint32_t queueFamily, uint32_t frameCount, uint32_t sectionCount)
+{
+    _device = device;
+    _sectionCount = sectionCount;
+    _milliseconds.assign(sectionCount, 0.0);
+    _resetFrames.assign(frameCount, false);
+    
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(*physicalDevice, &properties);
+    
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(*physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(*physicalDevice, &familyCount, families.data());
+    
+    uint32_t validBits = families[queueFamily].timestampValidBits;
+    _supported = validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+    if(!_supported) return;
+    
+    _timestampPeriod = properties.limits.timestampPeriod;
+    _validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = frameCount * sectionCount * 2;
+    
+    assert(vkCreateQueryPool(*_device, &poolInfo, nullptr, &_queryPool) == VK_SUCCESS);
+}
+
+
+void GpuTimer::Release()
+{
+    if(_queryPool != VK_NULL_HANDLE) vkDestroyQueryPool(*_device, _queryPool, nullptr);
+    _queryPool = VK_NULL_HANDLE;
+}
+
+
+void GpuTimer::Reset(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+    if(!_supported) return;
+    vkCmdResetQueryPool(commandBuffer, _queryPool, Query(frame, 0), _sectionCount * 2);
+    _resetFrames[frame] = true;
+}
+
+
+void GpuTimer::Begin(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t section)
+{
+    if(!_supported) return;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _queryPool, Query(frame, section));
+}
+
+
+void GpuTimer::End(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t section)
+{
+    if(!_supported) return;
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _queryPool, Query(frame, section) + 1);
+}
+
+
+void GpuTimer::Collect(uint32_t frame)
+{
+    if(!_supported || !_resetFrames[frame]) return;
+    
+    // value and availability of every query, an unrecorded one is unavailable and never waited for
+    std::vector<uint64_t> results(_sectionCount * 2 * 2);
+    vkGetQueryPoolResults(*_device, _queryPool, Query(frame, 0), _sectionCount * 2, results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    
+    for (uint32_t section = 0; section < _sectionCount; section++)
+    {
+        const uint64_t* begin = &results[section * 4];
+        const uint64_t* end = &results[section * 4 + 2];
+        if(!begin[1] || !end[1]) continue;
+        
+        uint64_t ticks = ((end[0] & _validMask) - (begin[0] & _validMask)) & _validMask;
+        _milliseconds[section] = ticks * _timestampPeriod * 1e-6;
+    }
+}
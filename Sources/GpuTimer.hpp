@@ -0,0 +1,38 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <vector>
+
+// timestamps around sections of the command buffer of each frame in flight,
+// read back once the frame has completed so nothing waits for them
+class GpuTimer
+{
+public:
+    // queueFamily runs the command buffers, every timer without timestamp support there reads 0
+    void Init(VkDevice* device, VkPhysicalDevice* physicalDevice, uint32_t queueFamily, uint32_t frameCount, uint32_t sectionCount);
+    void Release();
+    
+    // recorded outside a render pass before the first Begin of the frame
+    void Reset(VkCommandBuffer commandBuffer, uint32_t frame);
+    void Begin(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t section);
+    void End(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t section);
+    
+    // reads the sections of the last submission of this frame, which must have completed,
+    // sections it did not record keep their previous time
+    void Collect(uint32_t frame);
+    double GetMilliseconds(uint32_t section) const { return _milliseconds[section]; }
+    bool IsSupported() const { return _supported; }
+    
+private:
+    VkDevice* _device;
+    VkQueryPool _queryPool = VK_NULL_HANDLE;
+    bool _supported = false;
+    uint32_t _sectionCount = 0;
+    double _timestampPeriod = 1.0;
+    uint64_t _validMask = 0;
+    std::vector<double> _milliseconds;
+    // queries start undefined, a frame is only read back once a submission reset them
+    std::vector<bool> _resetFrames;
+    
+    uint32_t Query(uint32_t frame, uint32_t section) const { return (frame * _sectionCount + section) * 2; }
+};
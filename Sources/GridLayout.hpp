@@ -0,0 +1,32 @@
+#pragma once
+#include "BoidSimulator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// cell size and resolution of the uniform grid, shared by the grid_* passes (ComputeShader) and CellList
+struct GridLayout
+{
+    // resolution is clamped so the block sums of the gpu prefix sum fit in one workgroup
+    static constexpr uint32_t MAX_DIM = 64;
+    static constexpr uint32_t MAX_CELLS = MAX_DIM * MAX_DIM * MAX_DIM;
+    
+    float cellSize;
+    uint32_t dim;
+    
+    uint32_t CellCount() const { return dim * dim * dim; }
+    
+    // a cell must be at least as large as the largest distance of the enabled rules (+ padding)
+    static GridLayout For(const ParticleParameters& params, const ShaderConstants& constants, float padding = 0.0f)
+    {
+        float maxDistance = 0.0f;
+        if(constants.ENABLE_ATTRACTION) maxDistance = std::max(maxDistance, params.ATTRACTION_DISTANCE);
+        if(constants.ENABLE_ALIGNMENT) maxDistance = std::max(maxDistance, params.ALIGNMENT_DISTANCE);
+        if(constants.ENABLE_AVOIDANCE) maxDistance = std::max(maxDistance, params.AVOIDANCE_DISTANCE);
+        
+        GridLayout layout;
+        layout.cellSize = std::max(maxDistance + padding, constants.FIELD_SCALE / MAX_DIM);
+        layout.dim = std::min(std::max((uint32_t)std::ceil(constants.FIELD_SCALE / layout.cellSize), 1u), MAX_DIM);
+        return layout;
+    }
+};
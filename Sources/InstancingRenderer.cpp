@@ -2,22 +2,32 @@
 
 #include "Util.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_STATIC
 #include "stb_image.h"
 
-void InstancingRenderer::Init(VkDevice* device, VkPhysicalDevice* physicalDevice, VkRenderPass* renderPass, VkCommandPool* commandPool, VkQueue* queue, uint32_t particleNum, std::vector<VkBuffer> sharingBuffers)
+void InstancingRenderer::Init(VkDevice* device, VkPhysicalDevice* physicalDevice, VkRenderPass* renderPass, VkCommandPool* commandPool, VkQueue* queue, const ShaderConstants& constants, std::vector<VkBuffer> sharingBuffers, uint32_t computeFamily, uint32_t graphicsFamily)
 {
     _device = device;
     _physicalDevice = physicalDevice;
     _renderPass = renderPass;
     _commandPool = commandPool;
     _queue = queue;
-    _N = particleNum;
+    _constants = constants;
+    _capacity = constants.CAPACITY;
     _sharingBuffers = sharingBuffers;
+    _frameCount = static_cast<uint32_t>(sharingBuffers.size());
+    _computeFamily = computeFamily;
+    _graphicsFamily = graphicsFamily;
     
     CreateDescriptorSetLayout();
     CreateGraphicsPipeline();
+    CreateCullPipeline();
     
     CreateVertexBuffer();
     CreateIndexBuffer();
@@ -27,13 +37,23 @@ void InstancingRenderer::Init(VkDevice* device, VkPhysicalDevice* physicalDevice
     CreateTextureSampler();
     
     CreateUniformBuffers();
+    CreateCullBuffers();
     CreateDescriptorPool();
     CreateDescriptorSets();
 }
 
-void InstancingRenderer::Draw(uint32_t frame, VkCommandBuffer& commandBuffer)
+void InstancingRenderer::Cull(uint32_t frame, float interpolation, VkCommandBuffer& commandBuffer)
 {
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
+    // the last frame in this slot has completed, and the host barrier at the end of its Cull made the counts visible
+    CullResult* result = static_cast<CullResult*>(_cullBuffersMapped[frame]);
+    _cullStatistics.near = result->near.instanceCount;
+    _cullStatistics.far = result->far.vertexCount;
+    _cullStatistics.culled = result->total - result->near.instanceCount - result->far.vertexCount;
+    
+    CullResult reset{};
+    reset.near.indexCount = static_cast<uint32_t>(indices.size());
+    reset.far.instanceCount = 1;
+    memcpy(result, &reset, sizeof(CullResult));
     
     // Update ubo
     UniformBufferObject ubo{};
@@ -41,6 +61,22 @@ void InstancingRenderer::Draw(uint32_t frame, VkCommandBuffer& commandBuffer)
     ubo.view = glm::lookAt(glm::vec3(cameraPos.x, cameraPos.y, cameraPos.z), glm::vec3(cameraCenter.x,cameraCenter.y,cameraCenter.z), glm::vec3(0.0, 1.0, 0.0));
     ubo.proj = glm::perspective(glm::radians(cameraFov), 2600.0f / 1600.0f, 0.1f, 10.0f);
     ubo.proj[1][1] *= -1;
+    ubo.interpolation = interpolation;
+    ubo.boundingRadius = BoundingRadius();
+    ubo.frustumCulling = frustumCulling ? VK_TRUE : VK_FALSE;
+    ubo.cameraPosition = glm::vec4(glm::vec3(cameraPos), 1.0f);
+    ubo.impostorColor = _impostorColor;
+    ubo.impostorDistance = impostors ? impostorDistance : std::numeric_limits<float>::max();
+    ubo.drawDistance = drawDistance;
+    // a point half as wide as the fish is long, the fish is narrow
+    ubo.impostorScale = ubo.boundingRadius * std::abs(ubo.proj[1][1]) * viewportHeight * 0.5f;
+    
+    // left, right, bottom, top, near, far from the rows of the view projection (depth in [0, 1])
+    glm::mat4 viewProj = ubo.proj * ubo.view;
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+    glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2] };
+    for (int i = 0; i < 6; i++) ubo.frustumPlanes[i] = planes[i] / glm::length(glm::vec3(planes[i]));
     
     {
         VkDeviceSize bufferSize = sizeof(UniformBufferObject);
@@ -49,6 +85,43 @@ void InstancingRenderer::Draw(uint32_t frame, VkCommandBuffer& commandBuffer)
         vkUnmapMemory(*_device, _uniformBuffersMemory[frame]);
     }
     
+    // released by the compute family at the end of its submission, the semaphore wait of this submission covers these stages
+    if(_computeFamily != _graphicsFamily && !hostSharing)
+    {
+        VkBufferMemoryBarrier acquire{};
+        acquire.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        acquire.srcAccessMask = 0;
+        acquire.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        acquire.srcQueueFamilyIndex = _computeFamily;
+        acquire.dstQueueFamilyIndex = _graphicsFamily;
+        acquire.buffer = _sharingBuffers[frame];
+        acquire.offset = 0;
+        acquire.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, 1, &acquire, 0, nullptr);
+    }
+    
+    // one invocation per live particle, as the simulation passes
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout, 0, 1, &_descriptorSets[frame], 0, nullptr);
+    vkCmdDispatchIndirect(commandBuffer, _sharingBuffers[frame], ParticleLayout::SharedCountOffset(_capacity) + offsetof(ParticleLayout::ParticleCount, particleDispatch));
+    
+    VkMemoryBarrier cullBarrier{};
+    cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+    
+    // the counts are read back through the mapping the next time this slot is culled
+    VkMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+}
+
+void InstancingRenderer::Draw(uint32_t frame, VkCommandBuffer& commandBuffer)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
     
     // Draw
     VkBuffer vertexBuffers[] = {_vertexBuffer};
@@ -59,9 +132,64 @@ void InstancingRenderer::Draw(uint32_t frame, VkCommandBuffer& commandBuffer)
 
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSets[frame], 0, nullptr);
 
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), _N, 0, 0, 0);
+    // one instance per near fish
+    vkCmdDrawIndexedIndirect(commandBuffer, _cullBuffers[frame], offsetof(CullResult, near), 1, sizeof(VkDrawIndexedIndirectCommand));
+    
+    // one point per far fish, the descriptor set stays bound as both pipelines share the layout
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _impostorPipeline);
+    vkCmdDrawIndirect(commandBuffer, _cullBuffers[frame], offsetof(CullResult, far), 1, sizeof(VkDrawIndirectCommand));
+}
+
+void InstancingRenderer::SetShaderConstants(const ShaderConstants& constants)
+{
+    // the capacity sizes every buffer, see Resize
+    assert(constants.CAPACITY == _capacity);
+    
+    // only the scales are read by the vertex shader, the cull pass also runs with the workgroup size of the simulation
+    bool rebuild = constants.FIELD_SCALE != _constants.FIELD_SCALE || constants.FISH_SCALE != _constants.FISH_SCALE || constants.WORKGROUP_SIZE != _constants.WORKGROUP_SIZE;
+    _constants = constants;
+    if(!rebuild) return;
+    
+    vkDeviceWaitIdle(*_device);
+    DestroyPipelines();
+    CreateGraphicsPipeline();
+    CreateCullPipeline();
+}
+
+
+void InstancingRenderer::DestroyPipelines()
+{
+    vkDestroyPipeline(*_device, _pipeline, nullptr);
+    vkDestroyPipeline(*_device, _impostorPipeline, nullptr);
+    vkDestroyPipelineLayout(*_device, _pipelineLayout, nullptr);
+    vkDestroyPipeline(*_device, _cullPipeline, nullptr);
+    vkDestroyPipelineLayout(*_device, _cullPipelineLayout, nullptr);
+}
+
+void InstancingRenderer::Resize(const ShaderConstants& constants, std::vector<VkBuffer> sharingBuffers)
+{
+    vkDeviceWaitIdle(*_device);
+    vkDestroyDescriptorPool(*_device, _descriptorPool, nullptr);
+    DestroyCullBuffers();
     
+    _capacity = constants.CAPACITY;
+    _sharingBuffers = sharingBuffers;
     
+    CreateCullBuffers();
+    CreateDescriptorPool();
+    CreateDescriptorSets();
+    
+    // only the scales need a new pipeline
+    SetShaderConstants(constants);
+}
+
+
+// the fish mesh rotated around its position, see vertex.glsl
+float InstancingRenderer::BoundingRadius() const
+{
+    float radius = 0.0f;
+    for (const Vertex& vertex : vertices) radius = std::max(radius, glm::length(vertex.pos));
+    return radius * _constants.FISH_SCALE * _constants.FIELD_SCALE * 0.5f;
 }
 
 //todo
@@ -74,15 +202,14 @@ void InstancingRenderer::Release()
     vkDestroyBuffer(*_device, _vertexBuffer, nullptr);
     vkFreeMemory(*_device, _vertexBufferMemory, nullptr);
     
-    for (size_t i = 0; i < MAX_FRAMES; i++)
+    for (size_t i = 0; i < _frameCount; i++)
     {
         vkDestroyBuffer(*_device, _uniformBuffers[i], nullptr);
         vkFreeMemory(*_device, _uniformBuffersMemory[i], nullptr);
-        
-        vkDestroyBuffer(*_device, _instanceUniformBuffers[i], nullptr);
-        vkFreeMemory(*_device, _instanceUniformBuffersMemory[i], nullptr);
     }
     
+    DestroyCullBuffers();
+    
     vkDestroySampler(*_device, _textureSampler, nullptr);
     vkDestroyImageView(*_device, _textureImageView, nullptr);
 
@@ -90,8 +217,7 @@ void InstancingRenderer::Release()
     vkFreeMemory(*_device, _textureImageMemory, nullptr);
     
     
-    vkDestroyPipeline(*_device, _pipeline, nullptr);
-    vkDestroyPipelineLayout(*_device, _pipelineLayout, nullptr);
+    DestroyPipelines();
     
     vkDestroyDescriptorSetLayout(*_device, _descriptorSetLayout, nullptr);
 
@@ -104,7 +230,7 @@ void InstancingRenderer::CreateDescriptorSetLayout()
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     uboLayoutBinding.pImmutableSamplers = nullptr;
-    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     VkDescriptorSetLayoutBinding samplerLayoutBinding{};
     samplerLayoutBinding.binding = 1;
@@ -113,14 +239,17 @@ void InstancingRenderer::CreateDescriptorSetLayout()
     samplerLayoutBinding.pImmutableSamplers = nullptr;
     samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     
-    VkDescriptorSetLayoutBinding instanceUboLayoutBinding{};
-    instanceUboLayoutBinding.binding = 2;
-    instanceUboLayoutBinding.descriptorCount = 1;
-    instanceUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    instanceUboLayoutBinding.pImmutableSamplers = nullptr;
-    instanceUboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-    std::array<VkDescriptorSetLayoutBinding, 3> bindings = {uboLayoutBinding, samplerLayoutBinding, instanceUboLayoutBinding};
+    // 2-4 : newest positions, orientations and colors, 5-6 : positions and orientations of the state before,
+    // 7 : near indices, 8 : cull result, 9 : particle count (cull pass only), 10 : far indices
+    std::array<VkDescriptorSetLayoutBinding, 11> bindings = {uboLayoutBinding, samplerLayoutBinding};
+    for (uint32_t i = 2; i < bindings.size(); i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].pImmutableSamplers = nullptr;
+        bindings[i].stageFlags = i < 8 || i == 10 ? VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT : VK_SHADER_STAGE_COMPUTE_BIT;
+    }
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -136,12 +265,15 @@ void InstancingRenderer::CreateGraphicsPipeline()
 
     VkShaderModule vertShaderModule = Util::CreateShaderModule(*_device, vertShaderCode);
     VkShaderModule fragShaderModule = Util::CreateShaderModule(*_device, fragShaderCode);
+    
+    ShaderSpecialization specialization(_constants);
 
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
     vertShaderStageInfo.module = vertShaderModule;
     vertShaderStageInfo.pName = "main";
+    vertShaderStageInfo.pSpecializationInfo = specialization.Info();
 
     VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
     fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -273,9 +405,63 @@ void InstancingRenderer::CreateGraphicsPipeline()
 
     vkDestroyShaderModule(*_device, fragShaderModule, nullptr);
     vkDestroyShaderModule(*_device, vertShaderModule, nullptr);
+    
+    
+    // far fish, one point per fish read from the far indices without vertex buffers
+    auto impostorVertShaderCode = Util::ReadFile("../Shaders/impostor_vertex.spv");
+    auto impostorFragShaderCode = Util::ReadFile("../Shaders/impostor_fragment.spv");
+    
+    VkShaderModule impostorVertShaderModule = Util::CreateShaderModule(*_device, impostorVertShaderCode);
+    VkShaderModule impostorFragShaderModule = Util::CreateShaderModule(*_device, impostorFragShaderCode);
+    
+    shaderStages[0].module = impostorVertShaderModule;
+    shaderStages[1].module = impostorFragShaderModule;
+    
+    VkPipelineVertexInputStateCreateInfo impostorVertexInputInfo{};
+    impostorVertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+    
+    pipelineInfo.pVertexInputState = &impostorVertexInputInfo;
+    
+    assert(vkCreateGraphicsPipelines(*_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_impostorPipeline) == VK_SUCCESS);
+    
+    vkDestroyShaderModule(*_device, impostorFragShaderModule, nullptr);
+    vkDestroyShaderModule(*_device, impostorVertShaderModule, nullptr);
 }
 
 
+void InstancingRenderer::CreateCullPipeline()
+{
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
+
+    assert(vkCreatePipelineLayout(*_device, &pipelineLayoutInfo, nullptr, &_cullPipelineLayout) == VK_SUCCESS);
+    
+    auto cullShaderCode = Util::ReadFile("../Shaders/cull.spv");
+    VkShaderModule cullShaderModule = Util::CreateShaderModule(*_device, cullShaderCode);
+    
+    ShaderSpecialization specialization(_constants);
+    
+    VkPipelineShaderStageCreateInfo cullShaderStageInfo{};
+    cullShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    cullShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    cullShaderStageInfo.module = cullShaderModule;
+    cullShaderStageInfo.pName = "main";
+    cullShaderStageInfo.pSpecializationInfo = specialization.Info();
+    
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.layout = _cullPipelineLayout;
+    pipelineInfo.stage = cullShaderStageInfo;
+    
+    assert(vkCreateComputePipelines(*_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_cullPipeline) == VK_SUCCESS);
+    
+    vkDestroyShaderModule(*_device, cullShaderModule, nullptr);
+}
+
 
 void InstancingRenderer::CreateVertexBuffer()
 {
@@ -329,6 +515,18 @@ void InstancingRenderer::CreateTextureImage()
     
     assert(pixels);
     
+    // mean color of the opaque texels in linear space, the color of the impostors
+    glm::vec3 colorSum(0.0f);
+    float opaqueCount = 0.0f;
+    for (int i = 0; i < w * h; i++)
+    {
+        if(pixels[i * 4 + 3] < 128) continue;
+        glm::vec3 texel = glm::vec3(pixels[i * 4], pixels[i * 4 + 1], pixels[i * 4 + 2]) / 255.0f;
+        colorSum += glm::pow(texel, glm::vec3(2.2f));
+        opaqueCount += 1.0f;
+    }
+    _impostorColor = glm::vec4(opaqueCount > 0.0f ? colorSum / opaqueCount : glm::vec3(1.0f), 1.0f);
+    
 
     VkBuffer tempBuffer;
     VkDeviceMemory tempBufferMemory;
@@ -463,40 +661,72 @@ void InstancingRenderer::CreateUniformBuffers()
 {
     VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-    _uniformBuffers.resize(MAX_FRAMES);
-    _uniformBuffersMemory.resize(MAX_FRAMES);
-    _uniformBuffersMapped.resize(MAX_FRAMES);
-    
-    
-    VkDeviceSize instanceBufferSize = sizeof(InstanceParameters) * _N;
-    _instanceUniformBuffers.resize(MAX_FRAMES);
-    _instanceUniformBuffersMemory.resize(MAX_FRAMES);
-    _instanceUniformBuffersMapped.resize(MAX_FRAMES);
+    _uniformBuffers.resize(_frameCount);
+    _uniformBuffersMemory.resize(_frameCount);
+    _uniformBuffersMapped.resize(_frameCount);
 
-    for (size_t i = 0; i < MAX_FRAMES; i++)
+    for (size_t i = 0; i < _frameCount; i++)
     {
         Util::CreateBuffer(*_device, *_physicalDevice, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _uniformBuffers[i], _uniformBuffersMemory[i]);
+    }
+}
+
+
+void InstancingRenderer::CreateCullBuffers()
+{
+    _nearIndexBuffers.resize(_frameCount);
+    _nearIndexBuffersMemory.resize(_frameCount);
+    _farIndexBuffers.resize(_frameCount);
+    _farIndexBuffersMemory.resize(_frameCount);
+    _cullBuffers.resize(_frameCount);
+    _cullBuffersMemory.resize(_frameCount);
+    _cullBuffersMapped.resize(_frameCount);
+    
+    for (size_t i = 0; i < _frameCount; i++)
+    {
+        Util::CreateBuffer(*_device, *_physicalDevice, sizeof(uint32_t) * _capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _nearIndexBuffers[i], _nearIndexBuffersMemory[i]);
+        Util::CreateBuffer(*_device, *_physicalDevice, sizeof(uint32_t) * _capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _farIndexBuffers[i], _farIndexBuffersMemory[i]);
         
-        Util::CreateBuffer(*_device, *_physicalDevice, instanceBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _instanceUniformBuffers[i], _instanceUniformBuffersMemory[i]);
+        // small and reset by the host every frame
+        Util::CreateBuffer(*_device, *_physicalDevice, sizeof(CullResult), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _cullBuffers[i], _cullBuffersMemory[i]);
+        vkMapMemory(*_device, _cullBuffersMemory[i], 0, sizeof(CullResult), 0, &_cullBuffersMapped[i]);
+        memset(_cullBuffersMapped[i], 0, sizeof(CullResult));
+    }
+}
+
+
+void InstancingRenderer::DestroyCullBuffers()
+{
+    for (size_t i = 0; i < _frameCount; i++)
+    {
+        vkDestroyBuffer(*_device, _nearIndexBuffers[i], nullptr);
+        vkFreeMemory(*_device, _nearIndexBuffersMemory[i], nullptr);
+        vkDestroyBuffer(*_device, _farIndexBuffers[i], nullptr);
+        vkFreeMemory(*_device, _farIndexBuffersMemory[i], nullptr);
+        vkDestroyBuffer(*_device, _cullBuffers[i], nullptr);
+        vkFreeMemory(*_device, _cullBuffersMemory[i], nullptr);
     }
 }
 
 
 void InstancingRenderer::CreateDescriptorPool()
 {
+    // one set per frame, reading its sharing buffer
+    uint32_t setCount = _frameCount;
+    
     std::array<VkDescriptorPoolSize, 3> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES);
+    poolSizes[0].descriptorCount = setCount;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES);
-    poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES);
+    poolSizes[1].descriptorCount = setCount;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = setCount * 9;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES);
+    poolInfo.maxSets = setCount;
 
     assert(vkCreateDescriptorPool(*_device, &poolInfo, nullptr, &_descriptorPool) == VK_SUCCESS);
 }
@@ -505,18 +735,21 @@ void InstancingRenderer::CreateDescriptorPool()
 
 void InstancingRenderer::CreateDescriptorSets()
 {
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES, _descriptorSetLayout);
+    uint32_t setCount = _frameCount;
+    std::vector<VkDescriptorSetLayout> layouts(setCount, _descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = _descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES);
+    allocInfo.descriptorSetCount = setCount;
     allocInfo.pSetLayouts = layouts.data();
 
-    _descriptorSets.resize(MAX_FRAMES);
+    _descriptorSets.resize(setCount);
     assert(vkAllocateDescriptorSets(*_device, &allocInfo, _descriptorSets.data()) == VK_SUCCESS);
 
-    for (size_t i = 0; i < MAX_FRAMES; i++)
+    for (uint32_t i = 0; i < setCount; i++)
     {
+        VkBuffer sharingBuffer = _sharingBuffers[i];
+        
         VkDescriptorBufferInfo bufferInfo{};
         bufferInfo.buffer = _uniformBuffers[i];
         bufferInfo.offset = 0;
@@ -527,12 +760,20 @@ void InstancingRenderer::CreateDescriptorSets()
         imageInfo.imageView = _textureImageView;
         imageInfo.sampler = _textureSampler;
         
-        VkDescriptorBufferInfo bufferInfo2{};
-        bufferInfo2.buffer = _sharingBuffers[i];
-        bufferInfo2.offset = 0;
-        bufferInfo2.range = sizeof(InstanceParameters) * _N;
-
-        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+        std::array<VkDescriptorBufferInfo, 9> particleBufferInfos =
+        {
+            ParticleLayout::SharedStreamInfo(sharingBuffer, ParticleLayout::NEWEST_POSITION, _capacity),
+            ParticleLayout::SharedStreamInfo(sharingBuffer, ParticleLayout::NEWEST_ORIENTATION, _capacity),
+            ParticleLayout::SharedStreamInfo(sharingBuffer, ParticleLayout::COLOR, _capacity),
+            ParticleLayout::SharedStreamInfo(sharingBuffer, ParticleLayout::PREVIOUS_POSITION, _capacity),
+            ParticleLayout::SharedStreamInfo(sharingBuffer, ParticleLayout::PREVIOUS_ORIENTATION, _capacity),
+            VkDescriptorBufferInfo{ _nearIndexBuffers[i], 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ _cullBuffers[i], 0, VK_WHOLE_SIZE },
+            VkDescriptorBufferInfo{ sharingBuffer, ParticleLayout::SharedCountOffset(_capacity), sizeof(ParticleLayout::ParticleCount) },
+            VkDescriptorBufferInfo{ _farIndexBuffers[i], 0, VK_WHOLE_SIZE },
+        };
+
+        std::array<VkWriteDescriptorSet, 11> descriptorWrites{};
 
         descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[0].dstSet = _descriptorSets[i];
@@ -550,13 +791,16 @@ void InstancingRenderer::CreateDescriptorSets()
         descriptorWrites[1].descriptorCount = 1;
         descriptorWrites[1].pImageInfo = &imageInfo;
         
-        descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[2].dstSet = _descriptorSets[i];
-        descriptorWrites[2].dstBinding = 2;
-        descriptorWrites[2].dstArrayElement = 0;
-        descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[2].descriptorCount = 1;
-        descriptorWrites[2].pBufferInfo = &bufferInfo2;
+        for (uint32_t b = 0; b < particleBufferInfos.size(); b++)
+        {
+            descriptorWrites[2 + b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[2 + b].dstSet = _descriptorSets[i];
+            descriptorWrites[2 + b].dstBinding = 2 + b;
+            descriptorWrites[2 + b].dstArrayElement = 0;
+            descriptorWrites[2 + b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[2 + b].descriptorCount = 1;
+            descriptorWrites[2 + b].pBufferInfo = &particleBufferInfos[b];
+        }
 
         vkUpdateDescriptorSets(*_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
     }
@@ -7,22 +7,44 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/euler_angles.hpp>
 
+#include "ShaderConstants.hpp"
+#include "ParticleLayout.hpp"
+
+
+// fish of the last completed frame of this frame slot, near ones are drawn as meshes and far ones as points
+struct CullStatistics
+{
+    uint32_t near;
+    uint32_t far;
+    uint32_t culled;
+};
 
 class InstancingRenderer
 {
 private:
     
+    // std140, UniformBufferObject in render_common.glsl
     struct UniformBufferObject
     {
         alignas(16) glm::mat4 view;
         alignas(16) glm::mat4 proj;
+        alignas(16) glm::vec4 frustumPlanes[6];
+        alignas(16) glm::vec4 cameraPosition;
+        alignas(16) glm::vec4 impostorColor;
+        float interpolation;
+        float boundingRadius;
+        VkBool32 frustumCulling;
+        float impostorDistance;
+        float drawDistance;
+        float impostorScale;
     };
     
-    struct InstanceParameters
+    // indirect draws of the visible fish, the cull pass appends to near.instanceCount and far.vertexCount
+    struct CullResult
     {
-        alignas(16) glm::vec3 pos;
-        alignas(16) glm::vec3 vel;
-        alignas(16) glm::vec3 rgb;
+        VkDrawIndexedIndirectCommand near;
+        VkDrawIndirectCommand far;
+        uint32_t total;
     };
     
     struct Vertex
@@ -45,13 +67,16 @@ private:
         0, 1, 2, 2, 3, 0,
     };
     
-    const int MAX_FRAMES = 2;
-    uint32_t _N = 0;
+    uint32_t _frameCount = 0;
+    uint32_t _capacity = 0;
+    ShaderConstants _constants;
     
     const float FIELD_SCALE = 1.0f;
     
     void CreateDescriptorSetLayout();
     void CreateGraphicsPipeline();
+    void CreateCullPipeline();
+    void DestroyPipelines();
     
     void CreateVertexBuffer();
     void CreateIndexBuffer();
@@ -66,17 +91,27 @@ private:
     void CreateUniformBuffers();
     void CreateDescriptorPool();
     void CreateDescriptorSets();
+    void CreateCullBuffers();
+    void DestroyCullBuffers();
+    float BoundingRadius() const;
     
     VkDevice* _device;
     VkPhysicalDevice* _physicalDevice;
     VkRenderPass* _renderPass;
     VkCommandPool* _commandPool;
     VkQueue* _queue;
+    // one per frame in flight, see ParticleLayout::SharedStream, written and released by ComputeShader (or written by the host, see hostSharing)
     std::vector<VkBuffer> _sharingBuffers;
+    uint32_t _computeFamily;
+    uint32_t _graphicsFamily;
     
     VkDescriptorSetLayout _descriptorSetLayout;
     VkPipelineLayout _pipelineLayout;
     VkPipeline _pipeline;
+    // far fish as points, same layout as _pipeline
+    VkPipeline _impostorPipeline;
+    VkPipelineLayout _cullPipelineLayout;
+    VkPipeline _cullPipeline;
     
     VkBuffer _vertexBuffer;
     VkDeviceMemory _vertexBufferMemory;
@@ -87,24 +122,51 @@ private:
     VkDeviceMemory _textureImageMemory;
     VkImageView _textureImageView;
     VkSampler _textureSampler;
+    glm::vec4 _impostorColor;
     
     std::vector<VkBuffer> _uniformBuffers;
     std::vector<VkDeviceMemory> _uniformBuffersMemory;
     std::vector<void*> _uniformBuffersMapped;
-    std::vector<VkBuffer> _instanceUniformBuffers;
-    std::vector<VkDeviceMemory> _instanceUniformBuffersMemory;
-    std::vector<void*> _instanceUniformBuffersMapped;
 
     VkDescriptorPool _descriptorPool;
     std::vector<VkDescriptorSet> _descriptorSets;
     
+    // per frame, the near and far indices are sized by the capacity and the cull result is mapped for the statistics
+    std::vector<VkBuffer> _nearIndexBuffers;
+    std::vector<VkDeviceMemory> _nearIndexBuffersMemory;
+    std::vector<VkBuffer> _farIndexBuffers;
+    std::vector<VkDeviceMemory> _farIndexBuffersMemory;
+    std::vector<VkBuffer> _cullBuffers;
+    std::vector<VkDeviceMemory> _cullBuffersMemory;
+    std::vector<void*> _cullBuffersMapped;
+    CullStatistics _cullStatistics{};
+    
     
 public:
-    void Init(VkDevice* device, VkPhysicalDevice* physicalDevice, VkRenderPass* renderPass, VkCommandPool* commandPool, VkQueue* queue, uint32_t particleNum, std::vector<VkBuffer> _sharingBuffers);
+    // one sharing buffer per frame in flight, each holds constants.CAPACITY particles and how many are drawn, the command pool and queue belong to graphicsFamily
+    void Init(VkDevice* device, VkPhysicalDevice* physicalDevice, VkRenderPass* renderPass, VkCommandPool* commandPool, VkQueue* queue, const ShaderConstants& constants, std::vector<VkBuffer> sharingBuffers, uint32_t computeFamily, uint32_t graphicsFamily);
+    // acquires the sharing buffer of this frame and compacts the fish inside the view frustum and the draw distance
+    // between its state before and newest state into the near and far lists, interpolation in [0, 1], recorded outside the render pass
+    void Cull(uint32_t frame, float interpolation, VkCommandBuffer& commandBuffer);
+    // draws the near fish the last Cull of this frame kept as meshes, then the far ones as points
     void Draw(uint32_t frame, VkCommandBuffer& commandBuffer);
     void Release();
     
+    // new capacity and buffers, waits for the device
+    void Resize(const ShaderConstants& constants, std::vector<VkBuffer> sharingBuffers);
+    void SetShaderConstants(const ShaderConstants& constants);
+    CullStatistics GetCullStatistics() const { return _cullStatistics; }
+    
+    bool frustumCulling = true;
+    // distance level of detail, see Cull
+    bool impostors = true;
+    float impostorDistance = 1.5f;
+    float drawDistance = 10.0f;
+    // sizes the points, the projection assumes a 2600 x 1600 viewport
+    float viewportHeight = 1600.0f;
     float cameraFov = 45.0f;
+    // the sharing buffers are written through their mapping instead of released by the compute family, nothing to acquire
+    bool hostSharing = false;
     glm::vec4 cameraPos = glm::vec4(1.2f,  FIELD_SCALE/2.0f, FIELD_SCALE/2.0f, 0.0f);
     glm::vec4 cameraCenter = glm::vec4(FIELD_SCALE/2.0f,FIELD_SCALE/2.0f,FIELD_SCALE/2.0f, 0.0f);
 };
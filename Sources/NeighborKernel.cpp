@@ -0,0 +1,378 @@
+#include "NeighborKernel.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NEIGHBOR_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define NEIGHBOR_KERNEL_NEON
+#include <arm_neon.h>
+#endif
+
+
+void NeighborStreams::Resize(uint32_t count)
+{
+    for (std::vector<float>* stream : { &px, &py, &pz, &vx, &vy, &vz })
+    {
+        stream->resize(count);
+    }
+}
+
+void NeighborStreams::Load(const glm::vec4* positions, const glm::vec4* velocities, uint32_t first, uint32_t last)
+{
+    for (uint32_t i = first; i < last; i++)
+    {
+        px[i] = positions[i].x;
+        py[i] = positions[i].y;
+        pz[i] = positions[i].z;
+        vx[i] = velocities[i].x;
+        vy[i] = velocities[i].y;
+        vz[i] = velocities[i].z;
+    }
+}
+
+void NeighborStreams::Load(const glm::vec4* positions, const glm::vec4* velocities, const uint32_t* order, uint32_t first, uint32_t last)
+{
+    for (uint32_t k = first; k < last; k++)
+    {
+        uint32_t i = order[k];
+        px[k] = positions[i].x;
+        py[k] = positions[i].y;
+        pz[k] = positions[i].z;
+        vx[k] = velocities[i].x;
+        vy[k] = velocities[i].y;
+        vz[k] = velocities[i].z;
+    }
+}
+
+
+// addNeighborAt of boids_common.glsl one particle at a time
+static void NeighborsScalar(const NeighborStreams& s, uint32_t first, uint32_t last, glm::vec3 pos, const NeighborRules& rules, Neighborhood& n)
+{
+    for (uint32_t i = first; i < last; i++)
+    {
+        glm::vec3 p = glm::vec3(s.px[i], s.py[i], s.pz[i]);
+        float dist = glm::length(p - pos);
+        
+        if(dist < rules.attractionDistance)
+        {
+            n.attractionPosSum += p;
+            n.attractionNearCnt++;
+        }
+        
+        if(dist < rules.alignmentDistance)
+        {
+            n.alignmentVelSum += glm::vec3(s.vx[i], s.vy[i], s.vz[i]);
+            n.alignmentNearCnt++;
+        }
+        
+        if(dist < rules.avoidanceDistance)
+        {
+            n.avoidanceSum += pos - p;
+            n.avoidanceNearCnt++;
+        }
+    }
+}
+
+
+// NeighborsScalar with the deterministic sums of addNeighborAt
+static void NeighborsFixedPoint(const NeighborStreams& s, uint32_t first, uint32_t last, glm::vec3 pos, const NeighborRules& rules, Neighborhood& n)
+{
+    for (uint32_t i = first; i < last; i++)
+    {
+        glm::vec3 p = glm::vec3(s.px[i], s.py[i], s.pz[i]);
+        float dist = glm::length(p - pos);
+        
+        if(dist < rules.attractionDistance)
+        {
+            n.attractionFixed += FixedPoint::To(p - pos, rules.attractionDistance, rules.fixedLimit);
+            n.attractionNearCnt++;
+        }
+        
+        if(dist < rules.alignmentDistance)
+        {
+            n.alignmentFixed += FixedPoint::To(glm::vec3(s.vx[i], s.vy[i], s.vz[i]), rules.maxSpeed, rules.fixedLimit);
+            n.alignmentNearCnt++;
+        }
+        
+        if(dist < rules.avoidanceDistance)
+        {
+            n.avoidanceFixed += FixedPoint::To(pos - p, rules.avoidanceDistance, rules.fixedLimit);
+            n.avoidanceNearCnt++;
+        }
+    }
+}
+
+
+// the vector versions compute the distance like glm::length (multiply, add x y then z, square root) so every rule sees the same neighbors,
+// a comparison yields all ones per passing lane, the sums and with it and the counts subtract it (-1),
+// the avoidance sum collects p - pos and is negated once at the end, the last particles of the range that fill no vector go through the scalar loop
+#ifdef NEIGHBOR_KERNEL_X86
+
+__attribute__((target("avx2")))
+static float SumAVX2(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__attribute__((target("avx2")))
+static int SumAVX2(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("avx2")))
+static void NeighborsAVX2(const NeighborStreams& s, uint32_t first, uint32_t last, glm::vec3 pos, const NeighborRules& rules, Neighborhood& n)
+{
+    const __m256 posX = _mm256_set1_ps(pos.x);
+    const __m256 posY = _mm256_set1_ps(pos.y);
+    const __m256 posZ = _mm256_set1_ps(pos.z);
+    const __m256 attractionDistance = _mm256_set1_ps(rules.attractionDistance);
+    const __m256 alignmentDistance = _mm256_set1_ps(rules.alignmentDistance);
+    const __m256 avoidanceDistance = _mm256_set1_ps(rules.avoidanceDistance);
+    
+    __m256 attractionX = _mm256_setzero_ps(), attractionY = _mm256_setzero_ps(), attractionZ = _mm256_setzero_ps();
+    __m256 alignmentX = _mm256_setzero_ps(), alignmentY = _mm256_setzero_ps(), alignmentZ = _mm256_setzero_ps();
+    __m256 avoidanceX = _mm256_setzero_ps(), avoidanceY = _mm256_setzero_ps(), avoidanceZ = _mm256_setzero_ps();
+    __m256i attractionCnt = _mm256_setzero_si256(), alignmentCnt = _mm256_setzero_si256(), avoidanceCnt = _mm256_setzero_si256();
+    
+    uint32_t i = first;
+    for (; i + 8 <= last; i += 8)
+    {
+        __m256 px = _mm256_loadu_ps(&s.px[i]);
+        __m256 py = _mm256_loadu_ps(&s.py[i]);
+        __m256 pz = _mm256_loadu_ps(&s.pz[i]);
+        __m256 dx = _mm256_sub_ps(px, posX);
+        __m256 dy = _mm256_sub_ps(py, posY);
+        __m256 dz = _mm256_sub_ps(pz, posZ);
+        __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+        
+        __m256 attraction = _mm256_cmp_ps(dist, attractionDistance, _CMP_LT_OQ);
+        attractionX = _mm256_add_ps(attractionX, _mm256_and_ps(attraction, px));
+        attractionY = _mm256_add_ps(attractionY, _mm256_and_ps(attraction, py));
+        attractionZ = _mm256_add_ps(attractionZ, _mm256_and_ps(attraction, pz));
+        attractionCnt = _mm256_sub_epi32(attractionCnt, _mm256_castps_si256(attraction));
+        
+        __m256 alignment = _mm256_cmp_ps(dist, alignmentDistance, _CMP_LT_OQ);
+        alignmentX = _mm256_add_ps(alignmentX, _mm256_and_ps(alignment, _mm256_loadu_ps(&s.vx[i])));
+        alignmentY = _mm256_add_ps(alignmentY, _mm256_and_ps(alignment, _mm256_loadu_ps(&s.vy[i])));
+        alignmentZ = _mm256_add_ps(alignmentZ, _mm256_and_ps(alignment, _mm256_loadu_ps(&s.vz[i])));
+        alignmentCnt = _mm256_sub_epi32(alignmentCnt, _mm256_castps_si256(alignment));
+        
+        __m256 avoidance = _mm256_cmp_ps(dist, avoidanceDistance, _CMP_LT_OQ);
+        avoidanceX = _mm256_add_ps(avoidanceX, _mm256_and_ps(avoidance, dx));
+        avoidanceY = _mm256_add_ps(avoidanceY, _mm256_and_ps(avoidance, dy));
+        avoidanceZ = _mm256_add_ps(avoidanceZ, _mm256_and_ps(avoidance, dz));
+        avoidanceCnt = _mm256_sub_epi32(avoidanceCnt, _mm256_castps_si256(avoidance));
+    }
+    
+    n.attractionPosSum += glm::vec3(SumAVX2(attractionX), SumAVX2(attractionY), SumAVX2(attractionZ));
+    n.attractionNearCnt += SumAVX2(attractionCnt);
+    n.alignmentVelSum += glm::vec3(SumAVX2(alignmentX), SumAVX2(alignmentY), SumAVX2(alignmentZ));
+    n.alignmentNearCnt += SumAVX2(alignmentCnt);
+    n.avoidanceSum -= glm::vec3(SumAVX2(avoidanceX), SumAVX2(avoidanceY), SumAVX2(avoidanceZ));
+    n.avoidanceNearCnt += SumAVX2(avoidanceCnt);
+    
+    NeighborsScalar(s, i, last, pos, rules, n);
+}
+
+// same as NeighborsAVX2 with mask registers instead of and
+__attribute__((target("avx512f")))
+static void NeighborsAVX512(const NeighborStreams& s, uint32_t first, uint32_t last, glm::vec3 pos, const NeighborRules& rules, Neighborhood& n)
+{
+    const __m512 posX = _mm512_set1_ps(pos.x);
+    const __m512 posY = _mm512_set1_ps(pos.y);
+    const __m512 posZ = _mm512_set1_ps(pos.z);
+    const __m512 attractionDistance = _mm512_set1_ps(rules.attractionDistance);
+    const __m512 alignmentDistance = _mm512_set1_ps(rules.alignmentDistance);
+    const __m512 avoidanceDistance = _mm512_set1_ps(rules.avoidanceDistance);
+    const __m512i one = _mm512_set1_epi32(1);
+    
+    __m512 attractionX = _mm512_setzero_ps(), attractionY = _mm512_setzero_ps(), attractionZ = _mm512_setzero_ps();
+    __m512 alignmentX = _mm512_setzero_ps(), alignmentY = _mm512_setzero_ps(), alignmentZ = _mm512_setzero_ps();
+    __m512 avoidanceX = _mm512_setzero_ps(), avoidanceY = _mm512_setzero_ps(), avoidanceZ = _mm512_setzero_ps();
+    __m512i attractionCnt = _mm512_setzero_si512(), alignmentCnt = _mm512_setzero_si512(), avoidanceCnt = _mm512_setzero_si512();
+    
+    uint32_t i = first;
+    for (; i + 16 <= last; i += 16)
+    {
+        __m512 px = _mm512_loadu_ps(&s.px[i]);
+        __m512 py = _mm512_loadu_ps(&s.py[i]);
+        __m512 pz = _mm512_loadu_ps(&s.pz[i]);
+        __m512 dx = _mm512_sub_ps(px, posX);
+        __m512 dy = _mm512_sub_ps(py, posY);
+        __m512 dz = _mm512_sub_ps(pz, posZ);
+        __m512 dist = _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz)));
+        
+        __mmask16 attraction = _mm512_cmp_ps_mask(dist, attractionDistance, _CMP_LT_OQ);
+        attractionX = _mm512_mask_add_ps(attractionX, attraction, attractionX, px);
+        attractionY = _mm512_mask_add_ps(attractionY, attraction, attractionY, py);
+        attractionZ = _mm512_mask_add_ps(attractionZ, attraction, attractionZ, pz);
+        attractionCnt = _mm512_mask_add_epi32(attractionCnt, attraction, attractionCnt, one);
+        
+        __mmask16 alignment = _mm512_cmp_ps_mask(dist, alignmentDistance, _CMP_LT_OQ);
+        alignmentX = _mm512_mask_add_ps(alignmentX, alignment, alignmentX, _mm512_loadu_ps(&s.vx[i]));
+        alignmentY = _mm512_mask_add_ps(alignmentY, alignment, alignmentY, _mm512_loadu_ps(&s.vy[i]));
+        alignmentZ = _mm512_mask_add_ps(alignmentZ, alignment, alignmentZ, _mm512_loadu_ps(&s.vz[i]));
+        alignmentCnt = _mm512_mask_add_epi32(alignmentCnt, alignment, alignmentCnt, one);
+        
+        __mmask16 avoidance = _mm512_cmp_ps_mask(dist, avoidanceDistance, _CMP_LT_OQ);
+        avoidanceX = _mm512_mask_add_ps(avoidanceX, avoidance, avoidanceX, dx);
+        avoidanceY = _mm512_mask_add_ps(avoidanceY, avoidance, avoidanceY, dy);
+        avoidanceZ = _mm512_mask_add_ps(avoidanceZ, avoidance, avoidanceZ, dz);
+        avoidanceCnt = _mm512_mask_add_epi32(avoidanceCnt, avoidance, avoidanceCnt, one);
+    }
+    
+    n.attractionPosSum += glm::vec3(_mm512_reduce_add_ps(attractionX), _mm512_reduce_add_ps(attractionY), _mm512_reduce_add_ps(attractionZ));
+    n.attractionNearCnt += _mm512_reduce_add_epi32(attractionCnt);
+    n.alignmentVelSum += glm::vec3(_mm512_reduce_add_ps(alignmentX), _mm512_reduce_add_ps(alignmentY), _mm512_reduce_add_ps(alignmentZ));
+    n.alignmentNearCnt += _mm512_reduce_add_epi32(alignmentCnt);
+    n.avoidanceSum -= glm::vec3(_mm512_reduce_add_ps(avoidanceX), _mm512_reduce_add_ps(avoidanceY), _mm512_reduce_add_ps(avoidanceZ));
+    n.avoidanceNearCnt += _mm512_reduce_add_epi32(avoidanceCnt);
+    
+    NeighborsScalar(s, i, last, pos, rules, n);
+}
+
+#endif
+
+
+#ifdef NEIGHBOR_KERNEL_NEON
+
+static void NeighborsNEON(const NeighborStreams& s, uint32_t first, uint32_t last, glm::vec3 pos, const NeighborRules& rules, Neighborhood& n)
+{
+    const float32x4_t posX = vdupq_n_f32(pos.x);
+    const float32x4_t posY = vdupq_n_f32(pos.y);
+    const float32x4_t posZ = vdupq_n_f32(pos.z);
+    const float32x4_t attractionDistance = vdupq_n_f32(rules.attractionDistance);
+    const float32x4_t alignmentDistance = vdupq_n_f32(rules.alignmentDistance);
+    const float32x4_t avoidanceDistance = vdupq_n_f32(rules.avoidanceDistance);
+    
+    float32x4_t attractionX = vdupq_n_f32(0.0f), attractionY = vdupq_n_f32(0.0f), attractionZ = vdupq_n_f32(0.0f);
+    float32x4_t alignmentX = vdupq_n_f32(0.0f), alignmentY = vdupq_n_f32(0.0f), alignmentZ = vdupq_n_f32(0.0f);
+    float32x4_t avoidanceX = vdupq_n_f32(0.0f), avoidanceY = vdupq_n_f32(0.0f), avoidanceZ = vdupq_n_f32(0.0f);
+    int32x4_t attractionCnt = vdupq_n_s32(0), alignmentCnt = vdupq_n_s32(0), avoidanceCnt = vdupq_n_s32(0);
+    
+    auto masked = [](uint32x4_t mask, float32x4_t v) { return vreinterpretq_f32_u32(vandq_u32(mask, vreinterpretq_u32_f32(v))); };
+    
+    uint32_t i = first;
+    for (; i + 4 <= last; i += 4)
+    {
+        float32x4_t px = vld1q_f32(&s.px[i]);
+        float32x4_t py = vld1q_f32(&s.py[i]);
+        float32x4_t pz = vld1q_f32(&s.pz[i]);
+        float32x4_t dx = vsubq_f32(px, posX);
+        float32x4_t dy = vsubq_f32(py, posY);
+        float32x4_t dz = vsubq_f32(pz, posZ);
+        float32x4_t dist = vsqrtq_f32(vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz)));
+        
+        uint32x4_t attraction = vcltq_f32(dist, attractionDistance);
+        attractionX = vaddq_f32(attractionX, masked(attraction, px));
+        attractionY = vaddq_f32(attractionY, masked(attraction, py));
+        attractionZ = vaddq_f32(attractionZ, masked(attraction, pz));
+        attractionCnt = vsubq_s32(attractionCnt, vreinterpretq_s32_u32(attraction));
+        
+        uint32x4_t alignment = vcltq_f32(dist, alignmentDistance);
+        alignmentX = vaddq_f32(alignmentX, masked(alignment, vld1q_f32(&s.vx[i])));
+        alignmentY = vaddq_f32(alignmentY, masked(alignment, vld1q_f32(&s.vy[i])));
+        alignmentZ = vaddq_f32(alignmentZ, masked(alignment, vld1q_f32(&s.vz[i])));
+        alignmentCnt = vsubq_s32(alignmentCnt, vreinterpretq_s32_u32(alignment));
+        
+        uint32x4_t avoidance = vcltq_f32(dist, avoidanceDistance);
+        avoidanceX = vaddq_f32(avoidanceX, masked(avoidance, dx));
+        avoidanceY = vaddq_f32(avoidanceY, masked(avoidance, dy));
+        avoidanceZ = vaddq_f32(avoidanceZ, masked(avoidance, dz));
+        avoidanceCnt = vsubq_s32(avoidanceCnt, vreinterpretq_s32_u32(avoidance));
+    }
+    
+    n.attractionPosSum += glm::vec3(vaddvq_f32(attractionX), vaddvq_f32(attractionY), vaddvq_f32(attractionZ));
+    n.attractionNearCnt += vaddvq_s32(attractionCnt);
+    n.alignmentVelSum += glm::vec3(vaddvq_f32(alignmentX), vaddvq_f32(alignmentY), vaddvq_f32(alignmentZ));
+    n.alignmentNearCnt += vaddvq_s32(alignmentCnt);
+    n.avoidanceSum -= glm::vec3(vaddvq_f32(avoidanceX), vaddvq_f32(avoidanceY), vaddvq_f32(avoidanceZ));
+    n.avoidanceNearCnt += vaddvq_s32(avoidanceCnt);
+    
+    NeighborsScalar(s, i, last, pos, rules, n);
+}
+
+#endif
+
+
+bool NeighborKernel::IsSupported(Isa isa)
+{
+    switch (isa)
+    {
+        case Isa::Scalar:
+            return true;
+#ifdef NEIGHBOR_KERNEL_X86
+        case Isa::AVX2:
+            return __builtin_cpu_supports("avx2");
+        case Isa::AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef NEIGHBOR_KERNEL_NEON
+        // part of every aarch64 cpu
+        case Isa::NEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+
+NeighborKernel::Isa NeighborKernel::Best()
+{
+    for (Isa isa : { Isa::AVX512, Isa::AVX2, Isa::NEON })
+    {
+        if(IsSupported(isa)) return isa;
+    }
+    return Isa::Scalar;
+}
+
+
+NeighborKernel::Function NeighborKernel::Get(Isa isa)
+{
+    if(!IsSupported(isa)) return NeighborsScalar;
+    
+    switch (isa)
+    {
+#ifdef NEIGHBOR_KERNEL_X86
+        case Isa::AVX2:
+            return NeighborsAVX2;
+        case Isa::AVX512:
+            return NeighborsAVX512;
+#endif
+#ifdef NEIGHBOR_KERNEL_NEON
+        case Isa::NEON:
+            return NeighborsNEON;
+#endif
+        default:
+            return NeighborsScalar;
+    }
+}
+
+
+NeighborKernel::Function NeighborKernel::GetFixedPoint()
+{
+    return NeighborsFixedPoint;
+}
+
+
+const char* NeighborKernel::Name(Isa isa)
+{
+    switch (isa)
+    {
+        case Isa::Scalar: return "scalar";
+        case Isa::AVX2: return "avx2";
+        case Isa::AVX512: return "avx512";
+        case Isa::NEON: return "neon";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// sums of the particles within each rule distance, Neighborhood in boids_common.glsl
+struct Neighborhood
+{
+    glm::vec3 attractionPosSum = glm::vec3(0.0f);
+    int attractionNearCnt = 0;
+    glm::vec3 alignmentVelSum = glm::vec3(0.0f);
+    int alignmentNearCnt = 0;
+    glm::vec3 avoidanceSum = glm::vec3(0.0f);
+    int avoidanceNearCnt = 0;
+    // deterministic mode, sum of p - pos, v and pos - p in FixedPoint in place of the three sums above
+    glm::ivec3 attractionFixed = glm::ivec3(0);
+    glm::ivec3 alignmentFixed = glm::ivec3(0);
+    glm::ivec3 avoidanceFixed = glm::ivec3(0);
+};
+
+// 32 bit fixed point of the deterministic mode, toFixed and fromFixed of boids_common.glsl,
+// a value within range is at most limit units so capacity of them never overflow an int
+struct FixedPoint
+{
+    static float Limit(uint32_t capacity) { return static_cast<float>(0x7fffffffu / std::max(capacity, 1u)); }
+    static glm::ivec3 To(glm::vec3 v, float range, float limit) { return glm::ivec3(glm::clamp(v * (limit / range), -limit, limit)); }
+    static glm::vec3 From(glm::ivec3 v, float range, float limit) { return glm::vec3(v) / (limit / range); }
+};
+
+// rule distances, a rule switched off by the shader constants gets a negative one so no distance passes
+struct NeighborRules
+{
+    float attractionDistance;
+    float alignmentDistance;
+    float avoidanceDistance;
+    // range of the alignment sum and FixedPoint::Limit, only read by the fixed point loop
+    float maxSpeed;
+    float fixedLimit;
+};
+
+// positions and velocities of the read state as one float array per component
+class NeighborStreams
+{
+public:
+    void Resize(uint32_t count);
+    // copies [first, last) out of the vec4 streams
+    void Load(const glm::vec4* positions, const glm::vec4* velocities, uint32_t first, uint32_t last);
+    // slot k gets particle order[k], for the cell list
+    void Load(const glm::vec4* positions, const glm::vec4* velocities, const uint32_t* order, uint32_t first, uint32_t last);
+    
+    uint32_t Count() const { return static_cast<uint32_t>(px.size()); }
+    
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+};
+
+// the neighbor loop of compute.glsl (addNeighborAt over a range of the streams) for one particle,
+// written once per instruction set and picked at runtime, the neighbor counts match the scalar loop exactly,
+// the vector versions sum in lanes so the sums may differ from it in the last bits
+class NeighborKernel
+{
+public:
+    enum class Isa
+    {
+        Scalar,
+        AVX2,       // 8 neighbors per iteration
+        AVX512,     // 16 neighbors per iteration
+        NEON,       // 4 neighbors per iteration
+        Count
+    };
+    
+    // adds the particles in [first, last) of streams to n
+    typedef void (*Function)(const NeighborStreams& streams, uint32_t first, uint32_t last, glm::vec3 pos, const NeighborRules& rules, Neighborhood& n);
+    
+    // built into this binary and supported by the cpu it runs on
+    static bool IsSupported(Isa isa);
+    // widest supported one
+    static Isa Best();
+    static Function Get(Isa isa);
+    // the scalar loop summing in FixedPoint, the same sums in any neighbor order on any instruction set
+    static Function GetFixedPoint();
+    static const char* Name(Isa isa);
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+// particle state is stored as structure of arrays, one packed std430 vec4 per particle and stream
+//   state buffer (ring, one per frame in flight) : [position * capacity][velocity * capacity][orientation * capacity]
+//   color buffer (one for all)                : [rgb * capacity]
+//   sharing buffer (one per frame in flight)  : [newest position][newest orientation][previous position][previous orientation][rgb] * capacity, ParticleCount
+// so the neighbor loop streams positions only, and velocities of close particles,
+// the first N particles of every stream are alive
+class ParticleLayout
+{
+public:
+    enum Stream
+    {
+        POSITION = 0,
+        VELOCITY = 1,
+        // quaternion from the velocity, written by the simulation so the vertex shader only applies it
+        ORIENTATION = 2,
+        STREAM_COUNT
+    };
+    
+    static VkDeviceSize StreamSize(uint32_t particleNum) { return sizeof(glm::vec4) * particleNum; }
+    static VkDeviceSize StreamOffset(Stream stream, uint32_t particleNum) { return StreamSize(particleNum) * stream; }
+    static VkDeviceSize StateSize(uint32_t particleNum) { return StreamSize(particleNum) * STREAM_COUNT; }
+    
+    static VkDescriptorBufferInfo StreamInfo(VkBuffer buffer, Stream stream, uint32_t particleNum)
+    {
+        VkDescriptorBufferInfo info{};
+        info.buffer = buffer;
+        info.offset = StreamOffset(stream, particleNum);
+        info.range = StreamSize(particleNum);
+        return info;
+    }
+    
+    // what the renderer reads of a frame, copied out of the state and color buffers at the end of every compute submission
+    // so the next submission never writes what a frame in flight draws from, and may run on another queue
+    enum SharedStream
+    {
+        NEWEST_POSITION = 0,
+        NEWEST_ORIENTATION = 1,
+        PREVIOUS_POSITION = 2,
+        PREVIOUS_ORIENTATION = 3,
+        COLOR = 4,
+        SHARED_STREAM_COUNT
+    };
+    
+    static VkDeviceSize SharedCountOffset(uint32_t particleNum) { return StreamSize(particleNum) * SHARED_STREAM_COUNT; }
+    
+    static VkDescriptorBufferInfo SharedStreamInfo(VkBuffer buffer, SharedStream stream, uint32_t particleNum)
+    {
+        VkDescriptorBufferInfo info{};
+        info.buffer = buffer;
+        info.offset = StreamSize(particleNum) * stream;
+        info.range = StreamSize(particleNum);
+        return info;
+    }
+    
+    // the fish model faces +y, rotation from +y to the velocity as a quaternion (xyz vector part, w scalar part),
+    // orientationOf in boids_common.glsl
+    static glm::vec4 Orientation(glm::vec3 velocity)
+    {
+        glm::vec3 dir = glm::normalize(velocity);
+        float w = 1.0f + dir.y;
+        if(w < 1e-6f) return glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+        return glm::normalize(glm::vec4(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), dir), w));
+    }
+    
+    // live particle count on the gpu followed by the indirect arguments derived from it,
+    // ParticleCount in boids_common.glsl
+    struct ParticleCount
+    {
+        uint32_t N;
+        VkDispatchIndirectCommand particleDispatch;
+        VkDispatchIndirectCommand sortDispatch;
+    };
+    
+    static VkDeviceSize SharingSize(uint32_t particleNum) { return SharedCountOffset(particleNum) + sizeof(ParticleCount); }
+};
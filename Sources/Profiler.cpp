@@ -0,0 +1,102 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include "imgui.h"
+
+void Profiler::Init(const std::vector<std::string>& passNames)
+{
+    _passNames = passNames;
+    _frameMs.assign(HISTORY_FRAMES, 0.0f);
+    _passMs.assign(passNames.size(), std::vector<float>(HISTORY_FRAMES, 0.0f));
+    _next = 0;
+    _count = 0;
+    _frameNumber = 0;
+}
+
+
+void Profiler::AddFrame(double frameMs, const std::vector<double>& passMs)
+{
+    _frameMs[_next] = (float)frameMs;
+    for (size_t pass = 0; pass < _passMs.size() && pass < passMs.size(); pass++)
+    {
+        _passMs[pass][_next] = (float)passMs[pass];
+    }
+    
+    _next = (_next + 1) % HISTORY_FRAMES;
+    _count = std::min(_count + 1, HISTORY_FRAMES);
+    _frameNumber++;
+}
+
+
+double Profiler::AverageFrameMs() const
+{
+    return Average(_frameMs);
+}
+
+
+double Profiler::AveragePassMs(size_t pass) const
+{
+    return Average(_passMs[pass]);
+}
+
+
+double Profiler::Average(const std::vector<float>& ring) const
+{
+    size_t count = std::min(_count, AVERAGE_FRAMES);
+    if(count == 0) return 0.0;
+    
+    double sum = 0.0;
+    for (size_t i = 1; i <= count; i++) sum += ring[(_next + HISTORY_FRAMES - i) % HISTORY_FRAMES];
+    return sum / count;
+}
+
+
+void Profiler::ShowGUI()
+{
+    double frameMs = AverageFrameMs();
+    ImGui::Text("frame %.2f ms (cpu)", frameMs);
+    
+    // plotted oldest first, the ring starts at _next once full
+    size_t offset = _count == HISTORY_FRAMES ? _next : 0;
+    ImGui::PlotLines("##frame", _frameMs.data(), (int)_count, (int)offset, nullptr, 0.0f, (float)(frameMs * 2.0 + 1.0), ImVec2(0, 60));
+    
+    // every row pairs a frame with its own gpu passes, so the history ends the frames in flight before the current one
+    ImGui::TextUnformatted("rows lag the current frame by the frames in flight");
+    for (size_t pass = 0; pass < _passNames.size(); pass++)
+    {
+        double passMs = AveragePassMs(pass);
+        ImGui::Text("%-10s %6.3f ms", _passNames[pass].c_str(), passMs);
+        ImGui::SameLine(200);
+        ImGui::ProgressBar(frameMs > 0.0 ? (float)std::min(passMs / frameMs, 1.0) : 0.0f, ImVec2(-1, 0), "");
+    }
+    
+    if(ImGui::Button("Export CSV")) _exportStatus = ExportCSV(_exportPath) ? "saved " + _exportPath : "could not write " + _exportPath;
+    if(!_exportStatus.empty())
+    {
+        ImGui::SameLine();
+        ImGui::TextUnformatted(_exportStatus.c_str());
+    }
+}
+
+
+bool Profiler::ExportCSV(const std::string& path) const
+{
+    std::ofstream file(path);
+    if(!file) return false;
+    
+    file << "frame,frame_ms";
+    for (const std::string& name : _passNames) file << ',' << name << "_ms";
+    file << '\n';
+    
+    size_t first = _count == HISTORY_FRAMES ? _next : 0;
+    for (size_t i = 0; i < _count; i++)
+    {
+        size_t index = (first + i) % HISTORY_FRAMES;
+        file << _frameNumber - _count + i << ',' << _frameMs[index];
+        for (const std::vector<float>& pass : _passMs) file << ',' << pass[index];
+        file << '\n';
+    }
+    return true;
+}
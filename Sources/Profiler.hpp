@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// cpu frame times and gpu pass times of the last HISTORY_FRAMES frames,
+// shown as rolling averages and a frame time graph, exported as CSV,
+// a frame is added once its gpu times are read back, a few frames after it was submitted
+class Profiler
+{
+public:
+    void Init(const std::vector<std::string>& passNames);
+    // passMs in the order of the pass names
+    void AddFrame(double frameMs, const std::vector<double>& passMs);
+    
+    // averages over the last AVERAGE_FRAMES frames
+    double AverageFrameMs() const;
+    double AveragePassMs(size_t pass) const;
+    
+    // inside an ImGui window
+    void ShowGUI();
+    // one row per frame in history, oldest first
+    bool ExportCSV(const std::string& path) const;
+    // where the Export CSV button writes, profile.csv unless set
+    void SetExportPath(const std::string& path) { _exportPath = path; }
+    
+private:
+    static constexpr size_t HISTORY_FRAMES = 600;
+    static constexpr size_t AVERAGE_FRAMES = 60;
+    
+    std::vector<std::string> _passNames;
+    // rings of HISTORY_FRAMES, _next is the oldest entry once full
+    std::vector<float> _frameMs;
+    std::vector<std::vector<float>> _passMs;
+    size_t _next = 0;
+    size_t _count = 0;
+    uint64_t _frameNumber = 0;
+    std::string _exportPath = "profile.csv";
+    std::string _exportStatus;
+    
+    double Average(const std::vector<float>& ring) const;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <cstring>
+
+// values baked into the shaders as specialization constants,
+// constant_id i is the i-th member, pipelines are rebuilt when they change
+struct ShaderConstants
+{
+    // particles the buffers hold, the live count N is kept on the gpu
+    uint32_t CAPACITY = 0;
+    uint32_t WORKGROUP_SIZE = 256;
+    float FIELD_SCALE = 1.0f;
+    VkBool32 ENABLE_WALL_AVOIDANCE = VK_TRUE;
+    VkBool32 ENABLE_ATTRACTION = VK_TRUE;
+    VkBool32 ENABLE_ALIGNMENT = VK_TRUE;
+    VkBool32 ENABLE_AVOIDANCE = VK_TRUE;
+    VkBool32 ENABLE_VORTEX = VK_TRUE;
+    float FISH_SCALE = 0.035f;
+    // neighbor sums in fixed point, see toFixed in boids_common.glsl
+    VkBool32 DETERMINISTIC = VK_FALSE;
+    
+    bool operator==(const ShaderConstants& other) const { return memcmp(this, &other, sizeof(ShaderConstants)) == 0; }
+    bool operator!=(const ShaderConstants& other) const { return !(*this == other); }
+};
+
+// VkSpecializationInfo over a copy of ShaderConstants, keep it alive until the pipeline is created
+class ShaderSpecialization
+{
+public:
+    ShaderSpecialization(const ShaderConstants& constants) : _constants(constants)
+    {
+        static_assert(sizeof(ShaderConstants) == COUNT * sizeof(uint32_t), "every shader constant is 32 bit");
+        
+        for (uint32_t i = 0; i < COUNT; i++)
+        {
+            _entries[i].constantID = i;
+            _entries[i].offset = i * sizeof(uint32_t);
+            _entries[i].size = sizeof(uint32_t);
+        }
+        
+        _info.mapEntryCount = COUNT;
+        _info.pMapEntries = _entries.data();
+        _info.dataSize = sizeof(ShaderConstants);
+        _info.pData = &_constants;
+    }
+    
+    ShaderSpecialization(const ShaderSpecialization&) = delete;
+    ShaderSpecialization& operator=(const ShaderSpecialization&) = delete;
+    
+    const VkSpecializationInfo* Info() const { return &_info; }
+    
+private:
+    static const uint32_t COUNT = 10;
+    
+    ShaderConstants _constants;
+    std::array<VkSpecializationMapEntry, COUNT> _entries{};
+    VkSpecializationInfo _info{};
+};
@@ -0,0 +1,134 @@
+#include "SimulationThread.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+
+// seconds, same clock as App::Time
+static double Now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void SimulationThread::Start(CpuBoidSimulator* simulator, const SimulationSettings& settings)
+{
+    Stop();
+    
+    _simulator = simulator;
+    _published = settings;
+    _simulator->SetShaderConstants(settings.constants);
+    _simulator->SetParameters(settings.params);
+    _simulator->SetLodParameters(settings.lod);
+    _simulator->SetCellList(settings.cellList);
+    _rate = settings.rate;
+    _hashing = settings.constants.DETERMINISTIC;
+    
+    _dropped = 0;
+    _duplicated = 0;
+    _windowStart = Now();
+    _windowSteps = 0;
+    _stepsPerSecond = 0.0;
+    _stateHashes.clear();
+    
+    // the loaded state is drawn until the first step completes
+    PublishStep(_windowStart, true);
+    
+    _running = true;
+    _thread = std::thread(&SimulationThread::Loop, this);
+}
+
+
+void SimulationThread::Stop()
+{
+    if(!IsRunning()) return;
+    
+    _running = false;
+    _thread.join();
+}
+
+
+void SimulationThread::SetSettings(const SimulationSettings& settings)
+{
+    if(settings == _published) return;
+    
+    _published = settings;
+    _settings.Back() = settings;
+    _settings.Publish();
+}
+
+
+bool SimulationThread::AcquireNewest()
+{
+    if(_snapshots.Acquire()) return true;
+    
+    _duplicated++;
+    return false;
+}
+
+
+// one step per tick of the rate, a thread that falls behind runs flat out without a backlog to catch up on
+void SimulationThread::Loop()
+{
+    double next = Now();
+    
+    while(_running.load(std::memory_order_relaxed))
+    {
+        if(_settings.Acquire())
+        {
+            const SimulationSettings& settings = _settings.Front();
+            _simulator->SetShaderConstants(settings.constants);
+            _simulator->SetParameters(settings.params);
+            _simulator->SetLodParameters(settings.lod);
+            _simulator->SetCellList(settings.cellList);
+            _rate = settings.rate;
+            _hashing = settings.constants.DETERMINISTIC;
+        }
+        
+        _simulator->Advance(1);
+        if(_hashing) _stateHashes.emplace_back(_simulator->GetStepCount(), _simulator->GetStateHash());
+        
+        double now = Now();
+        _windowSteps++;
+        if(now - _windowStart >= 1.0)
+        {
+            _stepsPerSecond = _windowSteps / (now - _windowStart);
+            _windowStart = now;
+            _windowSteps = 0;
+        }
+        PublishStep(now, false);
+        
+        next += 1.0 / std::max(_rate, 1.0f);
+        if(next > now) std::this_thread::sleep_for(std::chrono::duration<double>(next - now));
+        else next = now;
+    }
+}
+
+
+// copies the newest state and the one before it (the other half of the simulator double buffer) into the back snapshot
+void SimulationThread::PublishStep(double now, bool initial)
+{
+    SimulationSnapshot& snapshot = _snapshots.Back();
+    uint32_t count = _simulator->GetParticleCount();
+    
+    const std::vector<glm::vec4>& positions = _simulator->GetPositions();
+    const std::vector<glm::vec4>& orientations = _simulator->GetOrientations();
+    const std::vector<glm::vec4>& previousPositions = initial ? positions : _simulator->GetPreviousPositions();
+    const std::vector<glm::vec4>& previousOrientations = initial ? orientations : _simulator->GetPreviousOrientations();
+    snapshot.positions.assign(positions.begin(), positions.begin() + count);
+    snapshot.orientations.assign(orientations.begin(), orientations.begin() + count);
+    snapshot.previousPositions.assign(previousPositions.begin(), previousPositions.begin() + count);
+    snapshot.previousOrientations.assign(previousOrientations.begin(), previousOrientations.begin() + count);
+    
+    snapshot.count = count;
+    snapshot.step = _simulator->GetStepCount();
+    snapshot.time = now;
+    snapshot.buildMs = _simulator->GetBuildMilliseconds();
+    snapshot.queryMs = _simulator->GetQueryMilliseconds();
+    snapshot.kernelName = _simulator->GetKernelName();
+    snapshot.threadCount = _simulator->GetThreadCount();
+    snapshot.stepsPerSecond = _stepsPerSecond;
+    snapshot.hash = _hashing ? (initial ? _simulator->GetStateHash() : _stateHashes.back().second) : 0;
+    
+    if(!_snapshots.Publish()) _dropped.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "CpuBoidSimulator.hpp"
+#include "TripleBuffer.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// what the render thread hands to the simulation thread, applied before the next step
+struct SimulationSettings
+{
+    ParticleParameters params{};
+    LodParameters lod;
+    ShaderConstants constants;
+    bool cellList = true;
+    // steps per second, the thread sleeps between steps when it is ahead
+    float rate = 60.0f;
+    
+    bool operator==(const SimulationSettings& other) const
+    {
+        return memcmp(&params, &other.params, sizeof(ParticleParameters)) == 0
+            && lod.MODE == other.lod.MODE && lod.CAMERA_POS == other.lod.CAMERA_POS && lod.NEAR_DISTANCE == other.lod.NEAR_DISTANCE
+            && lod.DISTANCE_STEP == other.lod.DISTANCE_STEP && lod.MAX_INTERVAL == other.lod.MAX_INTERVAL
+            && constants == other.constants && cellList == other.cellList && rate == other.rate;
+    }
+    bool operator!=(const SimulationSettings& other) const { return !(*this == other); }
+};
+
+// a completed step as the renderer draws it, the state before it is kept for the interpolation
+struct SimulationSnapshot
+{
+    std::vector<glm::vec4> positions;
+    std::vector<glm::vec4> orientations;
+    std::vector<glm::vec4> previousPositions;
+    std::vector<glm::vec4> previousOrientations;
+    uint32_t count = 0;
+    uint64_t step = 0;
+    // when the step completed, seconds of std::chrono::steady_clock
+    double time = 0.0;
+    double buildMs = 0.0;
+    double queryMs = 0.0;
+    // CpuBoidSimulator::GetKernelName and GetThreadCount, the simulator is not the render thread's to ask while it runs
+    const char* kernelName = "";
+    uint32_t threadCount = 0;
+    // measured over the last second
+    double stepsPerSecond = 0.0;
+    // StateHash of the step with ShaderConstants::DETERMINISTIC, 0 without
+    uint64_t hash = 0;
+};
+
+// runs a CpuBoidSimulator on its own thread at a fixed rate and publishes every step through a TripleBuffer,
+// the render thread takes the newest one whenever it draws, so neither ever waits for the other
+class SimulationThread
+{
+public:
+    ~SimulationThread() { Stop(); }
+    
+    // the simulator belongs to the thread until Stop
+    void Start(CpuBoidSimulator* simulator, const SimulationSettings& settings);
+    void Stop();
+    bool IsRunning() const { return _thread.joinable(); }
+    
+    // render thread side, only settings that differ from the last ones are handed over
+    void SetSettings(const SimulationSettings& settings);
+    // takes the newest published step, returns false if it is the one taken last time
+    bool AcquireNewest();
+    const SimulationSnapshot& Newest() const { return _snapshots.Front(); }
+    
+    // steps published that were never drawn and frames that drew a step again
+    uint64_t GetDroppedCount() const { return _dropped.load(std::memory_order_relaxed); }
+    uint64_t GetDuplicatedCount() const { return _duplicated; }
+    // (step, StateHash) of every step since Start with ShaderConstants::DETERMINISTIC, including dropped ones, read it after Stop
+    const std::vector<std::pair<uint64_t, uint64_t>>& GetStateHashes() const { return _stateHashes; }
+    
+private:
+    void Loop();
+    // initial publishes the loaded state as its own previous state
+    void PublishStep(double now, bool initial);
+    
+    CpuBoidSimulator* _simulator = nullptr;
+    std::thread _thread;
+    std::atomic<bool> _running{false};
+    
+    TripleBuffer<SimulationSettings> _settings;
+    TripleBuffer<SimulationSnapshot> _snapshots;
+    
+    // simulation thread only
+    float _rate = 60.0f;
+    bool _hashing = false;
+    double _windowStart = 0.0;
+    uint32_t _windowSteps = 0;
+    double _stepsPerSecond = 0.0;
+    std::vector<std::pair<uint64_t, uint64_t>> _stateHashes;
+    
+    std::atomic<uint64_t> _dropped{0};
+    // render thread only
+    uint64_t _duplicated = 0;
+    SimulationSettings _published;
+};
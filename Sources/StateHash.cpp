@@ -0,0 +1,22 @@
+#include "StateHash.hpp"
+
+
+static uint64_t Add(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+
+uint64_t StateHash::Of(const glm::vec4* positions, const glm::vec4* velocities, uint32_t count)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = Add(hash, positions, sizeof(glm::vec4) * count);
+    hash = Add(hash, velocities, sizeof(glm::vec4) * count);
+    return hash;
+}
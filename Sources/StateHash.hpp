@@ -0,0 +1,14 @@
+#pragma once
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// 64 bit FNV-1a over the bits of the positions and velocities of a state,
+// two runs of the deterministic mode match step for step only if their hashes do
+class StateHash
+{
+public:
+    static uint64_t Of(const glm::vec4* positions, const glm::vec4* velocities, uint32_t count);
+};
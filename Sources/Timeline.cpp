@@ -0,0 +1,42 @@
+#include "Timeline.hpp"
+
+void Timeline::Init(VkDevice* device)
+{
+    _device = device;
+    _pending = 0;
+    
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+    
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    
+    assert(vkCreateSemaphore(*_device, &semaphoreInfo, nullptr, &_semaphore) == VK_SUCCESS);
+}
+
+
+void Timeline::Release()
+{
+    vkDestroySemaphore(*_device, _semaphore, nullptr);
+    _semaphore = VK_NULL_HANDLE;
+}
+
+
+void Timeline::Wait(uint64_t value) const
+{
+    if(value == 0) return;
+    
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &_semaphore;
+    waitInfo.pValues = &value;
+    
+    // outside the assert, a build without asserts still waits
+    VkResult result = vkWaitSemaphores(*_device, &waitInfo, UINT64_MAX);
+    assert(result == VK_SUCCESS);
+    (void)result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+
+// timeline semaphore of one queue, every submission to the queue signals the next value,
+// so a wait names the submission it depends on instead of a fence per frame in flight
+class Timeline
+{
+public:
+    void Init(VkDevice* device);
+    void Release();
+    
+    // value the next submission signals
+    uint64_t Next() { return ++_pending; }
+    // value of the last submission, 0 before the first
+    uint64_t Pending() const { return _pending; }
+    
+    // blocks until the submission that signals value has completed, returns at once if it has
+    void Wait(uint64_t value) const;
+    
+    VkSemaphore Get() const { return _semaphore; }
+    
+private:
+    VkDevice* _device;
+    VkSemaphore _semaphore = VK_NULL_HANDLE;
+    uint64_t _pending = 0;
+};
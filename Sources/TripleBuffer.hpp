@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// single producer, single consumer exchange of the newest value without locks or waiting,
+// the producer fills the back slot and publishes it by swapping it with the middle one,
+// the consumer swaps the middle slot with its front one whenever a newer value was published
+template <typename T>
+class TripleBuffer
+{
+public:
+    // producer side, the slot the next Publish hands over
+    T& Back() { return _slots[_back]; }
+    
+    // returns false if the value published before was never acquired, it is dropped
+    bool Publish()
+    {
+        uint32_t previous = _middle.exchange(_back | FRESH, std::memory_order_acq_rel);
+        _back = previous & INDEX;
+        return (previous & FRESH) == 0;
+    }
+    
+    // consumer side, returns false if nothing was published since the last call and Front() is unchanged
+    bool Acquire()
+    {
+        // only the producer changes the middle slot meanwhile, and it always leaves it fresh
+        if((_middle.load(std::memory_order_relaxed) & FRESH) == 0) return false;
+        _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    
+    const T& Front() const { return _slots[_front]; }
+    
+private:
+    static constexpr uint32_t INDEX = 3;
+    static constexpr uint32_t FRESH = 4;
+    
+    T _slots[3];
+    uint32_t _back = 0;
+    // slot index, with FRESH set until the consumer takes it
+    std::atomic<uint32_t> _middle{1};
+    uint32_t _front = 2;
+};
@@ -0,0 +1,132 @@
+#include "WorkStealingPool.hpp"
+
+#include <algorithm>
+
+
+WorkStealingPool::WorkStealingPool(uint32_t threadCount)
+{
+    if(threadCount == 0) threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        _queues.push_back(std::make_unique<Queue>());
+    }
+    for (uint32_t i = 1; i < threadCount; i++)
+    {
+        _threads.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    
+    for (std::thread& thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+
+void WorkStealingPool::ParallelFor(uint32_t begin, uint32_t end, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& body)
+{
+    if(begin >= end) return;
+    grain = std::max(grain, 1u);
+    
+    uint32_t taskCount = (end - begin + grain - 1) / grain;
+    if(taskCount == 1 || _threads.empty())
+    {
+        body(begin, end);
+        return;
+    }
+    
+    // set before any chunk is queued, a worker still draining the previous loop may pick it up right away
+    _body = &body;
+    _remaining.store(taskCount, std::memory_order_release);
+    
+    // contiguous runs of chunks per worker so each starts on its own part of the range,
+    // stealing evens out the rest
+    uint32_t workerCount = GetThreadCount();
+    uint32_t perWorker = (taskCount + workerCount - 1) / workerCount;
+    for (uint32_t i = 0; i < taskCount; i++)
+    {
+        uint32_t first = begin + i * grain;
+        Queue& queue = *_queues[i / perWorker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({first, std::min(first + grain, end)});
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _generation++;
+    }
+    _wake.notify_all();
+    
+    Drain(0);
+    
+    // the last chunks may still run on other workers
+    while(_remaining.load(std::memory_order_acquire) > 0)
+    {
+        std::this_thread::yield();
+    }
+    _body = nullptr;
+}
+
+
+void WorkStealingPool::WorkerLoop(uint32_t worker)
+{
+    uint64_t seen = 0;
+    
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&]{ return _stop || _generation != seen; });
+            if(_stop) return;
+            seen = _generation;
+        }
+        
+        Drain(worker);
+    }
+}
+
+void WorkStealingPool::Drain(uint32_t worker)
+{
+    Task task;
+    while(Pop(worker, task) || Steal(worker, task))
+    {
+        (*_body)(task.first, task.last);
+        _remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+bool WorkStealingPool::Pop(uint32_t worker, Task& task)
+{
+    Queue& queue = *_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(queue.tasks.empty()) return false;
+    
+    task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::Steal(uint32_t thief, Task& task)
+{
+    uint32_t workerCount = GetThreadCount();
+    for (uint32_t i = 1; i < workerCount; i++)
+    {
+        Queue& queue = *_queues[(thief + i) % workerCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.tasks.empty()) continue;
+        
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
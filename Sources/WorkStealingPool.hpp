@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads for data parallel loops, every worker owns a deque of index ranges,
+// takes its own from the back and steals from the front of the others once it runs dry
+class WorkStealingPool
+{
+public:
+    // 0 threads uses every hardware thread, the calling thread counts as one of them
+    explicit WorkStealingPool(uint32_t threadCount = 0);
+    ~WorkStealingPool();
+    
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    
+    // calls body(first, last) over [begin, end) in chunks of grain indices and returns once all of them ran
+    void ParallelFor(uint32_t begin, uint32_t end, uint32_t grain, const std::function<void(uint32_t, uint32_t)>& body);
+    
+    uint32_t GetThreadCount() const { return static_cast<uint32_t>(_queues.size()); }
+    
+private:
+    struct Task
+    {
+        uint32_t first;
+        uint32_t last;
+    };
+    
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    
+    void WorkerLoop(uint32_t worker);
+    // runs tasks of this worker then of the others until none are left
+    void Drain(uint32_t worker);
+    bool Pop(uint32_t worker, Task& task);
+    bool Steal(uint32_t thief, Task& task);
+    
+    // queue 0 belongs to the thread calling ParallelFor, queue i to _threads[i - 1]
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _threads;
+    
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    uint64_t _generation = 0;
+    bool _stop = false;
+    
+    const std::function<void(uint32_t, uint32_t)>* _body = nullptr;
+    std::atomic<uint32_t> _remaining{0};
+};
@@ -1,8 +1,45 @@
 #include "App.hpp"
 
-int main()
+#include <cstdlib>
+#include <string>
+
+// --frames-in-flight N : frames recorded ahead of the gpu and simulation states kept, 2 to 4
+// --headless           : renders offscreen without a window and exits, prints the frame rate
+// --frames N           : frames a headless run renders, or measures per benchmark case
+// --warm-up-steps N    : steps simulated without rendering before the first frame
+// --profile-csv PATH   : writes the gpu pass times of the last frames on exit
+// --benchmark          : headless parameter sweep, see Benchmark for its options
+// --kernel-benchmark   : interactions per second of each cpu neighbor kernel over the --fish and distance sweeps
+// --cpu-simulation     : runs the flocking rules on cpu threads, the gpu only renders
+// --deterministic SEED : reproducible runs, spawns from SEED, sums in fixed point and hashes the state after every frame
+// --hash-output PATH   : writes the step and state hash of every frame of a deterministic run on exit
+int main(int argc, char** argv)
 {
-    App app;
+    AppSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--frames-in-flight" && hasValue) settings.framesInFlight = (uint32_t)std::atoi(argv[++i]);
+        else if(arg == "--frames" && hasValue) settings.frameCount = (uint32_t)std::atoi(argv[++i]);
+        else if(arg == "--warm-up-steps" && hasValue) settings.warmUpSteps = (uint32_t)std::atoi(argv[++i]);
+        else if(arg == "--profile-csv" && hasValue) settings.profileOutput = argv[++i];
+        else if(arg == "--headless") settings.headless = true;
+        else if(arg == "--benchmark") settings.runBenchmark = settings.headless = true;
+        else if(arg == "--kernel-benchmark") settings.runKernelBenchmark = true;
+        else if(arg == "--cpu-simulation") settings.cpuSimulation = true;
+        else if(arg == "--deterministic" && hasValue)
+        {
+            settings.deterministic = true;
+            settings.seed = (uint32_t)std::atoi(argv[++i]);
+        }
+        else if(arg == "--hash-output" && hasValue) settings.hashOutput = argv[++i];
+        else if(hasValue && settings.benchmark.ParseOption(arg, argv[i + 1])) i++;
+    }
+    
+    if(!settings.benchmark.IsValid()) return 1;
+    
+    App app(settings);
     app.Run();
     
     return 0;